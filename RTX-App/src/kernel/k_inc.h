@@ -68,6 +68,9 @@
 // The following offset macros needs to be modified if you modify
 // the positions of msp field in the TCB structure
 #define TCB_MSP_OFFSET  8       // TCB.msp offset 
+#define TCB_PRIV_OFFSET 12      // TCB.priv offset
+#define TCB_STATE_OFFSET 15     // TCB.state offset, K_SHARED_STACK only
+#define TCB_U_SP_OFFSET 36      // TCB.u_sp offset, K_SHARED_STACK only
 
 typedef struct tcb {
     struct tcb *prev;               /**< prev tcb, not used in the starter code     */
@@ -84,6 +87,17 @@ typedef struct tcb {
     U32         u_stack_size;       /**< user stack size in bytes                   */
     U32         u_sp;               /**< top of user stack                          */
     U32         u_sp_base;          /**< user stack base addr. (high addr.) */
+    mpool_t     heap;               /**< private heap pool id, MPID_NONE if none */
+    U32         mem_quota;          /**< MPID_IRAM1 quota in bytes, 0 = none */
+    U32         mem_used;           /**< MPID_IRAM1 bytes charged to the task */
+    U8          mem_wait;           /**< pressure level a BLK_MEM task waits for */
+    U64         cpu_user;           /**< DWT cycles run in thread mode */
+    U64         cpu_kernel;         /**< DWT cycles run in SVC_Handler on its behalf */
+    U32         ready_stamp;        /**< DWT->CYCCNT when last put on a ready queue */
+    struct magazine *mags;          /**< MPID_IRAM1 object caches per slab class, NULL until used */
+#ifdef STACK_CHECK
+    BOOL        stack_warned;       /**< STACK_CHECK already reported this task */
+#endif /* STACK_CHECK */
 } TCB;
 
 /*
@@ -98,20 +112,23 @@ extern int  errno;      // defined in k_rtx_init.c file
 extern const U32 g_k_stack_size;    // kernel stack size
 extern const U32 g_p_stack_size;    // process stack size
 
-// task kernel stacks are statically allocated inside the OS image
-extern U32 g_k_stacks[MAX_TASKS][KERN_STACK_SIZE >> 2] __attribute__((aligned(8)));
-
 // process stack for tasks, statically allocated inside the OS image  */
 //extern U32 g_p_stacks[MAX_TASKS][PROC_STACK_SIZE >> 2] __attribute__((aligned(8)));
 extern U32 g_p_stacks[NUM_TASKS][PROC_STACK_SIZE >> 2] __attribute__((aligned(8)));
 
+#ifdef K_SHARED_STACK
+// the one kernel stack all SVCs run on
+extern U32 g_k_stack[KERN_STACK_SIZE >> 2] __attribute__((aligned(8)));
+#endif /* K_SHARED_STACK */
+
 // task related globals are defined in k_task.c
 extern TCB *gp_current_task;    // always point to the current RUNNING task
 
-// TCBs are statically allocated inside the OS image
-extern TCB g_tcbs[MAX_TASKS];
+// TCBs are allocated from MPID_IRAM2 on demand, NULL for an unused tid
+extern TCB *g_tcbs[MAX_TASKS];
 extern TASK_INIT g_null_task_info;
 extern U32 g_num_active_tasks;	// number of non-dormant tasks */
+extern U32 g_svc_caller_pc;     // return address of the SVC being served
 
 #endif  // !K_INC_H_
 
@@ -40,6 +40,11 @@
 
 #include "k_inc.h"
 #include "k_mem.h"
+#include "k_task.h"
+
+#if MEM_SNAP_GRANULES != (RAM1_SIZE >> SLAB_MIN_SIZE_LOG2)
+#error "MEM_SNAP_GRANULES does not match the MPID_IRAM1 owner map"
+#endif
 
 /*---------------------------------------------------------------------------
 The memory map of the OS image may look like the following:
@@ -67,23 +72,9 @@ The memory map of the OS image may look like the following:
               g_p_stacks[1]-->|---------------------------|     |
                               |      PROC_STACK_SIZE      |     |
               g_p_stacks[0]-->|---------------------------|     |
-                              |   other  global vars      |     |
-                              |                           |  OS Image
-                              |---------------------------|     |
-                              |      KERN_STACK_SIZE      |     |                
-             g_k_stacks[15]-->|---------------------------|     |
-                              |                           |     |
-                              |     other kernel stacks   |     |                              
-                              |---------------------------|     |
-                              |      KERN_STACK_SIZE      |  OS Image
-              g_k_stacks[2]-->|---------------------------|     |
-                              |      KERN_STACK_SIZE      |     |                      
-              g_k_stacks[1]-->|---------------------------|     |
-                              |      KERN_STACK_SIZE      |     |
-              g_k_stacks[0]-->|---------------------------|     |
                               |   other  global vars      |     |
                               |---------------------------|     |
-                              |        TCBs               |  OS Image
+                              |     TCB pointers          |  OS Image
                       g_tcbs->|---------------------------|     |
                               |        global vars        |     |
                               |---------------------------|     |
@@ -105,15 +96,17 @@ const U32 g_k_stack_size = KERN_STACK_SIZE;
 // task proc space stack size in bytes, referred by system_a9.c
 const U32 g_p_stack_size = PROC_STACK_SIZE;
 
-// task kernel stacks
-U32 g_k_stacks[MAX_TASKS][KERN_STACK_SIZE >> 2] __attribute__((aligned(8)));
-
 // task process stack (i.e. user stack) for tasks in thread mode
 // remove this bug array in your lab2 code
 // the user stack should come from MPID_IRAM2 memory pool
 //U32 g_p_stacks[MAX_TASKS][PROC_STACK_SIZE >> 2] __attribute__((aligned(8)));
 U32 g_p_stacks[NUM_TASKS][PROC_STACK_SIZE >> 2] __attribute__((aligned(8)));
 
+#ifdef K_SHARED_STACK
+// kernel stack shared by all tasks, SVC_Handler moves MSP here at start up
+U32 g_k_stack[KERN_STACK_SIZE >> 2] __attribute__((aligned(8)));
+#endif /* K_SHARED_STACK */
+
 
 
 const int NUM_LEVELS_RAM1 = (RAM1_SIZE_LOG2 - MIN_BLK_SIZE_LOG2) + 1;
@@ -124,19 +117,123 @@ U8 *tree1 = NULL; // Array of length NUM_TREE_BITS in unmanaged memory
 
 const int NUM_LEVELS_RAM2 = (RAM2_SIZE_LOG2 - MIN_BLK_SIZE_LOG2) + 1;
 
-DLIST list2[NUM_LEVELS_RAM2]; // Array of length NUM_LEVELS in unmanaged memory
+DLIST list2[(RAM2_SIZE_LOG2 - MIN_BLK_SIZE_LOG2) + 1]; // Array of length NUM_LEVELS in unmanaged memory
 U8 tree2[2047]={0}; // Array of length NUM_TREE_BITS in unmanaged memory hardcoded
 
+// per order free blocks whose buddy merge is deferred (lazy buddy)
+LAZYLIST lazy1[MAX_LEVELS];
+LAZYLIST lazy2[MAX_LEVELS];
+
+// pool descriptors, MPID_IRAM1 and MPID_IRAM2 first, then task private heaps
+MPOOL g_mpools[NUM_MPOOLS];
+
+// slab layer for objects up to SLAB_MAX_SIZE bytes, carved from buddy pages
+SLAB_CACHE g_slab_caches[NUM_MPOOLS][SLAB_NUM_CLASSES];
+U8 slab_pages1[RAM1_SIZE >> SLAB_PAGE_LOG2_RAM1]; // non-zero if the page is a slab page
+U8 slab_pages2[RAM2_SIZE >> SLAB_PAGE_SIZE_LOG2];
+
+// user heap accounting, bytes are charged at block granularity
+U8 g_mem_owner[RAM1_SIZE >> SLAB_MIN_SIZE_LOG2]; // k_tsk_tag of the owner of the block starting at each 8B granule
+
+// MPID_IRAM1 pressure level and number of tasks blocked in mem_pressure_wait
+U8 g_mem_pressure = MEM_PRESSURE_NONE;
+U8 g_mem_waiters = 0;
+
+// user stacks of exited tasks per size class, recycled by k_stack_alloc
+LAZYLIST g_stack_pools[STACK_POOL_CLASSES];
+
+// kernel stack pages that have free stacks, see k_alloc_k_stack
+SLAB *g_kstack_pages = NULL;
+
+// MPID_IRAM2 blocks handed to tasks by mem_alloc_flags, a bit per 8B granule
+U8 g_mem_dma_map[RAM2_SIZE >> (SLAB_MIN_SIZE_LOG2 + 3)];
+U32 g_mem_dma_used = 0;
+
+// movable MPID_IRAM1 blocks, handle h lives in slot h - 1
+MHANDLE g_mhandles[MAX_MHANDLES];
+
+// pre-zeroed MPID_IRAM1 blocks per order for mem_calloc, only the link word
+// of a cached block is non-zero
+LAZYLIST g_zcache[MAX_LEVELS];
+
+// incremental heap checker state, advanced by the null task
+HEAP_CHECK g_heap_check;
+
+#ifdef MEM_PROFILE
+MEM_SITE g_mem_sites[PROF_SITES];                   // open addressed by caller PC
+U8 g_mem_site_of[RAM1_SIZE >> SLAB_MIN_SIZE_LOG2];  // site index + 1 of each block, 0 if none
+U32 g_mem_prof_lost = 0;                            // allocations with no free site
+#endif /* MEM_PROFILE */
+
 /*
  *===========================================================================
  *                            FUNCTIONS
  *===========================================================================
  */
 
+#ifdef DEBUG_HEAP
+static BOOL k_mpool_blk_start(mpool_t mpid, void *ptr);
+static void k_heap_dbg_report(char *what, void *ptr, HEAP_DBG_HDR *hdr);
+static BOOL k_mem_dma_marked(void *ptr);
+#endif /* DEBUG_HEAP */
+
+static BOOL k_mpool_valid(mpool_t mpid)
+{
+    return (mpid >= 0 && mpid < NUM_MPOOLS && g_mpools[mpid].active);
+}
+
+/**
+ * @brief   set up a private heap descriptor, metadata comes from MPID_IRAM2
+ * @return  the new pool id, RTX_ERR on failure
+ */
+static mpool_t k_mpool_create_priv(U32 start, U32 end)
+{
+    U32 size = end - start + 1;
+    int size_log2 = find_log(size);
+    int num_levels = size_log2 - MIN_BLK_SIZE_LOG2 + 1;
+    mpool_t mpid;
+    
+    // the slab page map and buddy math need a naturally aligned power of two
+    if ((size & (size - 1)) || (start & (size - 1)) ||
+        size < PRIV_HEAP_MIN_SIZE || num_levels > MAX_LEVELS) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    for (mpid = MAX_MPOOLS; mpid < NUM_MPOOLS; mpid++) {
+        if (!g_mpools[mpid].active) {
+            break;
+        }
+    }
+    if (mpid == NUM_MPOOLS) {
+        errno = EAGAIN;
+        return RTX_ERR;
+    }
+    
+    U32 meta_size = num_levels * (sizeof(DLIST) + sizeof(LAZYLIST)) +
+                    (computer_pwr2(num_levels) - 1) + (size >> SLAB_PAGE_SIZE_LOG2);
+    U8 *meta = k_mpool_alloc(MPID_IRAM2, meta_size);
+    if (meta == NULL) {
+        return RTX_ERR;     // errno set by k_mpool_alloc
+    }
+    
+    MPOOL *pool = &g_mpools[mpid];
+    pool->size_log2 = size_log2;
+    pool->meta = meta;
+    pool->list = (DLIST *)meta;
+    pool->lazy = (LAZYLIST *)(pool->list + num_levels);
+    pool->tree = (U8 *)(pool->lazy + num_levels);
+    pool->slab_pages = pool->tree + computer_pwr2(num_levels) - 1;
+    pool->slab_log2 = SLAB_PAGE_SIZE_LOG2;
+    pool->slab_max = SLAB_MAX_SIZE;
+    return mpid;
+}
+
 /* note list[n] is for blocks with order of n */
 mpool_t k_mpool_create (int algo, U32 start, U32 end)
 {
     mpool_t mpid = MPID_IRAM1;
+    MPOOL *pool;
 
 #ifdef DEBUG_0
     printf("k_mpool_init: algo = %d\r\n", algo);
@@ -148,71 +245,166 @@ mpool_t k_mpool_create (int algo, U32 start, U32 end)
         return RTX_ERR;
     }
     
-    if ( start == RAM1_START) {
-      // Setup first block that holds all memory
-      DNODE *ptr = (void *) start; // 8-byte alignment not needed for this lab
-			ptr->next = NULL;
-			ptr->prev = NULL;
-			ptr->treepos = 0;
-			
+    if ( start == RAM1_START && end == RAM1_END) {
 			list1 = (void*)&Image$$RW_IRAM1$$ZI$$Limit;
 			tree1 = (U8*)list1 + (sizeof(DLIST) * NUM_LEVELS_RAM1);
-			int num_tree_bits = computer_pwr2(NUM_LEVELS_RAM1) - 1;
 			
-			for (int i = 0; i<num_tree_bits; i++)
+			pool = &g_mpools[MPID_IRAM1];
+			pool->size_log2 = RAM1_SIZE_LOG2;
+			pool->list = list1;
+			pool->tree = tree1;
+			pool->lazy = lazy1;
+			pool->slab_pages = slab_pages1;
+			pool->slab_log2 = SLAB_PAGE_LOG2_RAM1;
+			pool->slab_max = SLAB_MAX_SIZE_RAM1;
+			pool->meta = NULL;
+			
+			for (int i = 0; i < (RAM1_SIZE >> SLAB_MIN_SIZE_LOG2); i++)
 			{
-				tree1[i] = 0;
+				g_mem_owner[i] = TID_UNK;
 			}
+			g_mem_pressure = MEM_PRESSURE_NONE;
+			g_mem_waiters = 0;
 			
-			for (int i = 0; i<NUM_LEVELS_RAM1; i++)
+			for (int i = 0; i < MAX_MHANDLES; i++)
 			{
-				list1[i].head = NULL;
+				g_mhandles[i].ptr = NULL;
+				g_mhandles[i].locks = 0;
 			}
 			
-			list1[0].head = ptr;
-			list1[0].tail = ptr;
+			for (int i = 0; i < MAX_LEVELS; i++)
+			{
+				g_zcache[i].head = NULL;
+				g_zcache[i].count = 0;
+			}
 			
-    } else if ( start == RAM2_START) { 
-      mpid = MPID_IRAM2;
-      DNODE *ptr = (void *) start; // 8-byte alignment not needed for this lab
-			ptr->next = NULL;
-			ptr->prev = NULL;
-			ptr->treepos = 0; 
+			g_heap_check.mpid = MPID_IRAM1;
+			g_heap_check.tree = FALSE;
+			g_heap_check.level = 0;
+			g_heap_check.index = 0;
+			g_heap_check.errors = 0;
 			
-			for (int i = 0; i<NUM_LEVELS_RAM2; i++)
+#ifdef MEM_PROFILE
+			for (int i = 0; i < PROF_SITES; i++)
 			{
-				list2[i].head = NULL;
+				g_mem_sites[i].pc = 0;
 			}
+			k_mem_zero(g_mem_site_of, sizeof(g_mem_site_of));
+			g_mem_prof_lost = 0;
+#endif /* MEM_PROFILE */
+			
+    } else if ( start == RAM2_START && end == RAM2_END) { 
+      mpid = MPID_IRAM2;
+			pool = &g_mpools[MPID_IRAM2];
+			pool->size_log2 = RAM2_SIZE_LOG2;
+			pool->list = list2;
+			pool->tree = tree2;
+			pool->lazy = lazy2;
+			pool->slab_pages = slab_pages2;
+			pool->slab_log2 = SLAB_PAGE_SIZE_LOG2;
+			pool->slab_max = SLAB_MAX_SIZE;
+			pool->meta = NULL;
+			
+			k_mem_zero(g_mem_dma_map, sizeof(g_mem_dma_map));
+			g_mem_dma_used = 0;
 			
-      list2[0].head = ptr;
-			list2[0].tail = ptr;
+			for (int i = 0; i < STACK_POOL_CLASSES; i++)
+			{
+				g_stack_pools[i].head = NULL;
+				g_stack_pools[i].count = 0;
+			}
+			g_kstack_pages = NULL;
     } else {
+        mpid = k_mpool_create_priv(start, end);
+        if (mpid < 0) {
+            return RTX_ERR;
+        }
+        pool = &g_mpools[mpid];
+    }
+    
+    pool->start = start;
+    pool->end = end;
+    pool->num_levels = pool->size_log2 - MIN_BLK_SIZE_LOG2 + 1;
+    
+    pool->free_bytes = computer_pwr2(pool->size_log2);
+    
+    int num_tree_bits = computer_pwr2(pool->num_levels) - 1;
+    k_mem_zero(pool->tree, num_tree_bits);
+    k_mem_zero(pool->slab_pages, 1 << (pool->size_log2 - pool->slab_log2));
+    
+    for (int i = 0; i<pool->num_levels; i++)
+    {
+        pool->list[i].head = NULL;
+        pool->list[i].tail = NULL;
+        pool->lazy[i].head = NULL;
+        pool->lazy[i].count = 0;
+    }
+    
+    for (int i = 0; i < SLAB_NUM_CLASSES; i++) {
+        g_slab_caches[mpid][i].partial = NULL;
+    }
+    
+    // Setup first block that holds all memory
+    DNODE *ptr = (void *) start; // 8-byte alignment not needed for this lab
+    ptr->next = NULL;
+    ptr->prev = NULL;
+    ptr->treepos = 0;
+    pool->list[0].head = ptr;
+    pool->list[0].tail = ptr;
+    
+    pool->active = TRUE;
+    return mpid;
+}
+
+/**
+ * @brief   release a private heap descriptor and its metadata
+ * @note    the memory region itself belongs to the caller
+ */
+int k_mpool_destroy(mpool_t mpid)
+{
+    if (mpid < MAX_MPOOLS || !k_mpool_valid(mpid)) {
         errno = EINVAL;
         return RTX_ERR;
     }
     
-    return mpid;
+    g_mpools[mpid].active = FALSE;
+    return k_mpool_dealloc(MPID_IRAM2, g_mpools[mpid].meta);
 }
 
-void *k_mpool_alloc (mpool_t mpid, size_t size)
+/**
+ * @brief   find the pool a pointer belongs to
+ * @return  the pool id, MPID_NONE if ptr is in no pool
+ * @note    private heaps nest inside a system pool, so they are checked first
+ */
+mpool_t k_mpool_find(void *ptr)
+{
+    for (mpool_t mpid = NUM_MPOOLS - 1; mpid >= 0; mpid--) {
+        MPOOL *pool = &g_mpools[mpid];
+        if (pool->active && pool->start <= (U32)ptr && (U32)ptr <= pool->end) {
+            return mpid;
+        }
+    }
+    return MPID_NONE;
+}
+
+static void *k_mpool_alloc_blk (mpool_t mpid, size_t size)
 {
-#ifdef DEBUG_0
-    printf("k_mpool_alloc: mpid = %d, size = %d, 0x%x\r\n", mpid, size, size);
-#endif /* DEBUG_0 */
     
     if (size == 0) {
         return NULL;
     }
-		if (size > IRAM1_SIZE) //************************** replace ***
-		{
-			errno = ENOMEM;
-			return NULL;
-		}
 
-    if (mpid != MPID_IRAM1 && mpid != MPID_IRAM2) {
+    if (!k_mpool_valid(mpid)) {
         errno = EINVAL;
         return NULL;
     }
+    
+		MPOOL *pool = &g_mpools[mpid];
+		if (size > computer_pwr2(pool->size_log2))
+		{
+			errno = ENOMEM;
+			return NULL;
+		}
 		
 		size_t blk_size = size;
     if (blk_size < MIN_BLK_SIZE)
@@ -221,33 +413,22 @@ void *k_mpool_alloc (mpool_t mpid, size_t size)
     }
    
 		
-		int lvl;
-		DLIST *list; //list to use
-		U8 *tree; //tree to use
-		if (mpid == MPID_IRAM1)
+		int lvl = pool->size_log2 - find_log(blk_size);
+		DLIST *list = pool->list; //list to use
+		U8 *tree = pool->tree; //tree to use
+		LAZYLIST *lazy = pool->lazy; //deferred blocks to use
+		// A deferred block of the exact order is still marked used in the tree,
+		// hand it out as is without any split
+		if (lazy[lvl].head != NULL)
 		{
-			unsigned int pwr = find_log(blk_size);
-			lvl = RAM1_SIZE_LOG2 - pwr;
-			list = list1;
-			tree = tree1;
-			if (size > RAM1_SIZE) 
-			{
-				errno = ENOMEM;
-				return NULL;
-			}
+			DNODE *node = lazy[lvl].head;
+			lazy[lvl].head = node->next;
+			lazy[lvl].count--;
+			node->next = NULL;
+			node->prev = NULL;
+			pool->free_bytes -= computer_pwr2(pool->size_log2 - lvl);
+			return node;
 		}
-		else
-		{
-			unsigned int pwr = find_log(blk_size);
-			lvl = RAM2_SIZE_LOG2 - pwr;
-			list = list2;
-			tree = tree2;
-			if (size > RAM2_SIZE) 
-			{
-				errno = ENOMEM;
-				return NULL;
-			}
-		}	
 		//exit if trying to alloc biggest block possible and it is occupied
 		if ((lvl ==0)&&(list[lvl].head == NULL))
 		{
@@ -269,6 +450,7 @@ void *k_mpool_alloc (mpool_t mpid, size_t size)
 			node->next = NULL;
 			node->prev = NULL;
 			tree[pos] = 1;
+			pool->free_bytes -= computer_pwr2(pool->size_log2 - lvl);
 			return memptr;
 		}
 		// No more blocks at that level, go up levels until we find one, then split it
@@ -298,15 +480,7 @@ void *k_mpool_alloc (mpool_t mpid, size_t size)
 			int child2 = child1+1;
 
 			DNODE *ptr1 = list[lvl-k].head; //do some math to get mem ptr...
-			DNODE *ptr2;
-			if (mpid == MPID_IRAM1)
-			{
-				ptr2 = (DNODE*)((char*)ptr1 + RAM1_SIZE / pwr);
-			}
-			else
-			{
-				ptr2 = (DNODE*)((char*)ptr1 + RAM2_SIZE / pwr);
-			}
+			DNODE *ptr2 = (DNODE*)((char*)ptr1 + computer_pwr2(pool->size_log2) / pwr);
 			
 			list[lvl-k].head = list[lvl-k].head->next;
 			k--; //go down a lvl
@@ -332,58 +506,77 @@ void *k_mpool_alloc (mpool_t mpid, size_t size)
 		node->next = NULL;
 		node->prev = NULL;
 		tree[pos] = 1;
+		pool->free_bytes -= computer_pwr2(pool->size_log2 - lvl);
 		return memptr;
 	}
 }
 
+void *k_mpool_alloc (mpool_t mpid, size_t size)
+{
+#ifdef DEBUG_0
+    printf("k_mpool_alloc: mpid = %d, size = %d, 0x%x\r\n", mpid, size, size);
+#endif /* DEBUG_0 */
+    
+    void *ptr;
+    BOOL small = (size > 0 && k_mpool_valid(mpid) && size <= g_mpools[mpid].slab_max);
+    
+    ptr = small ? k_slab_alloc(mpid, size) : k_mpool_alloc_blk(mpid, size);
+    
+    // out of memory, give back cached and deferred blocks and try once more
+    if (ptr == NULL && errno == ENOMEM && k_mpool_reclaim(mpid) > 0) {
+        ptr = small ? k_slab_alloc(mpid, size) : k_mpool_alloc_blk(mpid, size);
+    }
+    return ptr;
+}
+
 int k_mpool_dealloc(mpool_t mpid, void *ptr)
 {
 #ifdef DEBUG_0
     printf("k_mpool_dealloc: mpid = %d, ptr = 0x%x\r\n", mpid, ptr);
 #endif /* DEBUG_0 */
+#ifdef DEBUG_HEAP
+    if (ptr != NULL && k_mpool_valid(mpid) && !k_mpool_blk_start(mpid, ptr)) {
+        k_heap_dbg_report("not an allocated block", ptr, NULL);
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+#endif /* DEBUG_HEAP */
+    if (k_slab_owns(mpid, ptr)) {
+        return k_slab_free(mpid, ptr);
+    }
+    return k_mpool_free(mpid, ptr, TRUE);
+}
+
+/**
+ * @brief   return a block to the pool
+ * @param   lazy_ok TRUE to park the block on the deferred list of its order
+ *                  if that list is below LAZY_WATERMARK, FALSE to coalesce now
+ */
+int k_mpool_free(mpool_t mpid, void *ptr, BOOL lazy_ok)
+{
     if (ptr == NULL) {
         return RTX_OK; // deallocating null is a no-op
     }
-    if (mpid != MPID_IRAM1 && mpid != MPID_IRAM2) {
+    if (!k_mpool_valid(mpid)) {
         errno = EINVAL;
         return RTX_ERR;
     }
-    unsigned int offset = 0;
-		
-    if (((void*)RAM1_START <= ptr) && (ptr <= (void*)RAM1_END)) {
-        //in RAM 1
-        offset = (char*)ptr - (char*)RAM1_START;
-    } else if (((void*)RAM2_START <= ptr) && (ptr <= (void*)RAM2_END)) {
-    	//in RAM 2
-        offset = (char*)ptr - (char*)RAM2_START;
-    } else {
+    
+    MPOOL *pool = &g_mpools[mpid];
+    if (((U32)ptr < pool->start) || ((U32)ptr > pool->end)) {
         errno = EFAULT;
         return RTX_ERR;
     }
-	
+    unsigned int offset = (char*)ptr - (char*)pool->start;
 		
-		int pwr = computer_pwr2(5); //2^5 is the smallest block size
+		int pwr = computer_pwr2(MIN_BLK_SIZE_LOG2); //2^5 is the smallest block size
 		int x = offset/pwr;
-		int k;
-		unsigned int treeIndex;		
-		
-		DLIST *list; //list to use
-		U8 *tree; //tree to use
-		if (mpid == MPID_IRAM1)
-		{
-			k = NUM_LEVELS_RAM1 -1;
-			treeIndex = x + computer_pwr2(k) - 1;
-			list = list1;
-			tree = tree1;
-		}
-		else
-		{
-			k = NUM_LEVELS_RAM2 -1;
-			treeIndex = x + computer_pwr2(k) - 1;
-			list = list2;
-			tree = tree2;
-		}
+		int k = pool->num_levels - 1;
+		unsigned int treeIndex = x + computer_pwr2(k) - 1;
 		
+		DLIST *list = pool->list; //list to use
+		U8 *tree = pool->tree; //tree to use
+		LAZYLIST *lazy = pool->lazy; //deferred blocks to use
 		
 		DNODE* ptr_to_use = ptr;		
 		while((tree[treeIndex]!=1)&&(k>0))
@@ -392,6 +585,19 @@ int k_mpool_dealloc(mpool_t mpid, void *ptr)
 			x = x/2; //offset from lvl
 			treeIndex = x + computer_pwr2(k) - 1;
 		}
+		pool->free_bytes += computer_pwr2(pool->size_log2 - k);
+		
+		// defer the merge, the next alloc of this order pops it back in O(1)
+		if (lazy_ok && (k > 0) && (lazy[k].count < LAZY_WATERMARK))
+		{
+			DNODE *node = ptr;
+			node->treepos = treeIndex;
+			node->prev = NULL;
+			node->next = lazy[k].head;
+			lazy[k].head = node;
+			lazy[k].count++;
+			return RTX_OK;
+		}
 		
 		if (treeIndex == 0)
 		{
@@ -463,7 +669,7 @@ int k_mpool_dealloc(mpool_t mpid, void *ptr)
 						node1->treepos = 0;
 						node1->next = NULL;
 						node1->prev = NULL;
-						tree[treeIndex] = 0;
+						tree[0] = 0; // the root is free again
 						list[0].head= ptr_to_use;
 					}
 					if ((buddyindex==2)&&(treeIndex==1))
@@ -472,7 +678,7 @@ int k_mpool_dealloc(mpool_t mpid, void *ptr)
 						node1->treepos = 0;
 						node1->next = NULL;
 						node1->prev = NULL;
-						tree[treeIndex] = 0;
+						tree[0] = 0;
 						list[0].head= ptr_to_use;
 					}
 			}
@@ -502,111 +708,2021 @@ int k_mpool_dealloc(mpool_t mpid, void *ptr)
     return RTX_OK; 
 }
 
-int k_mpool_dump (mpool_t mpid)
+/**
+ * @brief   coalesce deferred free blocks back into the buddy free lists
+ * @param   budget  max number of blocks to coalesce, negative for all
+ * @return  number of blocks coalesced
+ */
+int k_mpool_lazy_flush(mpool_t mpid, int budget)
 {
-#ifdef DEBUG_0
-    printf("k_mpool_dump: mpid = %d\r\n", mpid);
-#endif /* DEBUG_0 */
-    if (mpid != MPID_IRAM1 && mpid != MPID_IRAM2)
-	{
-        errno = EINVAL;
-        return NULL;
+    if (!k_mpool_valid(mpid)) {
+        return 0;
     }
-    int total = 0;
-    unsigned long size = 0;
-		
-		DLIST *list; //list to use
-		int log_size;
-		int max_lvls;
-		if (mpid == MPID_IRAM1)
-		{
-		
-			list = list1;
-			log_size = RAM1_SIZE_LOG2;
-			max_lvls = NUM_LEVELS_RAM1; 
-		}
-		else
-		{
-	
-			list = list2;
-			log_size = RAM2_SIZE_LOG2;
-			max_lvls = NUM_LEVELS_RAM2; 
-		}
-		for (int k = 0; k < max_lvls; k++)
-		{
-			DNODE *temp = list[k].head;
-			
-			while(temp!=NULL)
-			{
-				size = computer_pwr2(log_size-k);
-				printf("0x%x: 0x%x\r\n", temp, size);
-				total++;
-				temp=temp->next;	
-			}
-			
-		}
-		printf("%d free memory block(s) found\r\n", total);
-    return total;
+    
+    LAZYLIST *lazy = g_mpools[mpid].lazy;
+    int merged = 0;
+    
+    // larger orders first, they give back the most contiguous space
+    for (int k = 1; k < g_mpools[mpid].num_levels; k++) {
+        while (lazy[k].head != NULL && (budget < 0 || merged < budget)) {
+            DNODE *node = lazy[k].head;
+            lazy[k].head = node->next;
+            lazy[k].count--;
+            // already counted free, k_mpool_free counts it again
+            g_mpools[mpid].free_bytes -= computer_pwr2(g_mpools[mpid].size_log2 - k);
+            k_mpool_free(mpid, node, FALSE);
+            merged++;
+        }
+    }
+    return merged;
 }
- 
-int k_mem_init(int algo)
+
+/**
+ * @brief   memory housekeeping done from the null task
+ * @return  number of blocks coalesced or moved
+ */
+int k_mem_idle(void)
 {
-#ifdef DEBUG_0
-    printf("k_mem_init: algo = %d\r\n", algo);
-#endif /* DEBUG_0 */
-        
-    if ( k_mpool_create(algo, RAM1_START, RAM1_END) < 0 ) {
-        return RTX_ERR;
+    int merged = 0;
+    
+    for (mpool_t mpid = 0; mpid < NUM_MPOOLS; mpid++) {
+        merged += k_mpool_lazy_flush(mpid, LAZY_IDLE_BUDGET);
     }
+    merged += k_mem_compact(COMPACT_IDLE_BUDGET);
+    k_mem_zcache_fill(ZERO_IDLE_BUDGET);
+    k_mem_check(HEAP_CHECK_BUDGET);
+    return merged;
+}
+
+/**
+ * @brief   zero free MPID_IRAM1 blocks ahead of mem_calloc, smallest order first
+ * @return  number of blocks zeroed
+ * @note    only blocks already free at the exact order are taken, larger
+ *          blocks are never split to fill the cache, and only while
+ *          ZERO_CACHE_HEADROOM bytes stay free next to the parked block
+ */
+int k_mem_zcache_fill(int budget)
+{
+    MPOOL *pool = &g_mpools[MPID_IRAM1];
+    int filled = 0;
     
-    if ( k_mpool_create(algo, RAM2_START, RAM2_END) < 0 ) {
-        return RTX_ERR;
+    // smaller orders are cheap to zero on demand
+    for (U32 size = SLAB_MAX_SIZE << 1; size <= ZERO_CACHE_MAX_SIZE; size <<= 1) {
+        int k = pool->size_log2 - find_log(size);
+        LAZYLIST *zc = &g_zcache[k];
+        while (zc->count < ZERO_CACHE_DEPTH && filled < budget &&
+               pool->free_bytes >= size + ZERO_CACHE_HEADROOM &&
+               (pool->list[k].head != NULL || pool->lazy[k].head != NULL)) {
+            DNODE *node = k_mpool_alloc_blk(MPID_IRAM1, size);
+            k_mem_zero(node, size);
+            node->next = zc->head;
+            zc->head = node;
+            zc->count++;
+            filled++;
+        }
+    }
+    return filled;
+}
+
+/**
+ * @brief   take a pre-zeroed block for a request of size bytes
+ * @return  the block, NULL if none is cached for that order
+ */
+static void *k_mem_zcache_pop(size_t size)
+{
+    if (size <= SLAB_MAX_SIZE || size > ZERO_CACHE_MAX_SIZE) {
+        return NULL;
     }
     
-    return RTX_OK;
+    LAZYLIST *zc = &g_zcache[g_mpools[MPID_IRAM1].size_log2 - find_log(size)];
+    DNODE *node = zc->head;
+    if (node != NULL) {
+        zc->head = node->next;
+        zc->count--;
+        node->next = NULL;  // the link word is the only dirty one
+    }
+    return node;
 }
 
 /**
- * @brief allocate kernel stack statically
+ * @brief   return the pooled user stacks to MPID_IRAM2
  */
-U32* k_alloc_k_stack(task_t tid)
+static int k_stack_pool_flush(void)
 {
+    int freed = 0;
     
-    if ( tid >= MAX_TASKS) {
-        errno = EAGAIN;
-        return NULL;
+    for (int i = 0; i < STACK_POOL_CLASSES; i++) {
+        while (g_stack_pools[i].head != NULL) {
+            DNODE *node = g_stack_pools[i].head;
+            g_stack_pools[i].head = node->next;
+            g_stack_pools[i].count--;
+            k_mpool_free(MPID_IRAM2, node, FALSE);
+            freed++;
+        }
     }
-    U32 *sp = g_k_stacks[tid+1];
+    return freed;
+}
+
+/**
+ * @brief   header of the kernel stack page holding stack
+ * @note    the header sits at the top of the page, where no stack can
+ *          overflow into it
+ */
+static SLAB *k_kstack_page_of(void *stack)
+{
+    return (SLAB *)(((U32)stack & ~(KSTACK_PAGE_SIZE - 1)) + KSTACK_PAGE_SIZE - SLAB_HDR_SIZE);
+}
+
+/**
+ * @brief   give the kernel stack pages with no stack in use back to buddy
+ */
+static int k_kstack_reclaim(void)
+{
+    SLAB **pp = &g_kstack_pages;
+    int freed = 0;
     
-    // 8B stack alignment adjustment
-    if ((U32)sp & 0x04) {   // if sp not 8B aligned, then it must be 4B aligned
-        sp--;               // adjust it to 8B aligned
+    while (*pp != NULL) {
+        SLAB *page = *pp;
+        if (page->nfree == KSTACK_PER_PAGE) {
+            *pp = page->next;
+            k_mpool_free(MPID_IRAM2, (void *)((U32)page & ~(KSTACK_PAGE_SIZE - 1)), FALSE);
+            freed++;
+        } else {
+            pp = &page->next;
+        }
     }
-    return sp;
+    return freed;
 }
 
 /**
- * @brief allocate user/process stack statically
- * @attention  you should not use this function in your lab
+ * @brief   give the pre-zeroed MPID_IRAM1 blocks back to the buddy lists
  */
+static int k_mem_zcache_flush(void)
+{
+    int freed = 0;
+    
+    for (int k = 0; k < MAX_LEVELS; k++) {
+        while (g_zcache[k].head != NULL) {
+            DNODE *node = g_zcache[k].head;
+            g_zcache[k].head = node->next;
+            g_zcache[k].count--;
+            k_mpool_free(MPID_IRAM1, node, FALSE);
+            freed++;
+        }
+    }
+    return freed;
+}
 
-U32* k_alloc_p_stack(task_t tid)
+static void k_mem_check_report(mpool_t mpid, void *addr, char *what)
 {
-    if ( tid >= NUM_TASKS ) {
-        errno = EAGAIN;
-        return NULL;
+    g_heap_check.errors++;
+    printf("heap check: mpid %d, 0x%x: %s\r\n", mpid, addr, what);
+}
+
+static BOOL k_mem_check_in_pool(MPOOL *pool, void *ptr)
+{
+    return ((U32)ptr >= pool->start && (U32)ptr <= pool->end);
+}
+
+/**
+ * @brief   verify one free block of level k against the buddy tree
+ * @return  number of inconsistencies found
+ */
+static int k_mem_check_node(mpool_t mpid, int k, DNODE *node)
+{
+    MPOOL *pool = &g_mpools[mpid];
+    U32 errors = g_heap_check.errors;
+    
+    if (!k_mem_check_in_pool(pool, node)) {
+        k_mem_check_report(mpid, node, "free block out of pool");
+        return 1;   // nothing else can be read safely
     }
     
-    U32 *sp = g_p_stacks[tid+1];
+    U32 offset = (U32)node - pool->start;
+    int blk_log2 = pool->size_log2 - k;
+    int pos = (offset >> blk_log2) + computer_pwr2(k) - 1;
     
+    if (offset & (computer_pwr2(blk_log2) - 1)) {
+        k_mem_check_report(mpid, node, "free block misaligned for its level");
+    } else if (node->treepos != pos) {
+        k_mem_check_report(mpid, node, "treepos does not match address");
+    } else if (pool->tree[pos] != 0) {
+        k_mem_check_report(mpid, node, "free block marked used in tree");
+    } else if (k > 0 && pool->tree[(pos - 1) >> 1] != 1) {
+        k_mem_check_report(mpid, node, "parent of free block not split");
+    } else if (k > 0 && pool->tree[(pos & 1) ? pos + 1 : pos - 1] == 0) {
+        k_mem_check_report(mpid, node, "free buddies not coalesced");
+    }
     
-    // 8B stack alignment adjustment
-    if ((U32)sp & 0x04) {   // if sp not 8B aligned, then it must be 4B aligned
-        sp--;               // adjust it to 8B aligned
+    if (node->next != NULL && node->next->prev != node) {
+        k_mem_check_report(mpid, node, "broken free list link");
     }
-    return sp;
+    return g_heap_check.errors - errors;
 }
 
+/**
+ * @brief   verify one buddy tree node, a free node has no used descendants
+ * @return  number of inconsistencies found
+ */
+static int k_mem_check_tree(mpool_t mpid, int pos)
+{
+    MPOOL *pool = &g_mpools[mpid];
+    U8 *tree = pool->tree;
+    int child = 2 * pos + 1;
+    int k = find_log(pos + 2) - 1;      // level of the node
+    void *addr = (void *)(pool->start + (find_block_num(pos) << (pool->size_log2 - k)));
+    
+    if (tree[pos] > 1) {
+        k_mem_check_report(mpid, addr, "corrupt tree node");
+        return 1;
+    }
+    if (tree[pos] == 0 && k < pool->num_levels - 1 &&
+        (tree[child] != 0 || tree[child + 1] != 0)) {
+        k_mem_check_report(mpid, addr, "free block has used descendants");
+        return 1;
+    }
+    return 0;
+}
+
+static void k_mem_check_next_pool(HEAP_CHECK *chk)
+{
+    chk->mpid = (chk->mpid + 1) % NUM_MPOOLS;
+    chk->tree = FALSE;
+    chk->level = 0;
+    chk->index = 0;
+}
+
+/**
+ * @brief   check up to budget free list entries or tree nodes, resuming
+ *          where the previous call stopped
+ * @return  number of inconsistencies found in this slice
+ * @note    lists may change between calls, the position is kept as an
+ *          index so a stale node pointer is never followed
+ */
+int k_mem_check(int budget)
+{
+    HEAP_CHECK *chk = &g_heap_check;
+    int errors = 0;
+    
+    for (int step = 0; step < budget; step++) {
+        if (!k_mpool_valid(chk->mpid)) {
+            k_mem_check_next_pool(chk);
+            continue;
+        }
+        
+        MPOOL *pool = &g_mpools[chk->mpid];
+        
+        if (chk->tree) {
+            errors += k_mem_check_tree(chk->mpid, chk->index);
+            if (++chk->index == computer_pwr2(pool->num_levels) - 1) {
+                k_mem_check_next_pool(chk);
+            }
+            continue;
+        }
+        
+        // a bad link already reported ends the walk of its level
+        DNODE *node = pool->list[chk->level].head;
+        for (int i = 0; i < chk->index && node != NULL; i++) {
+            node = k_mem_check_in_pool(pool, node) ? node->next : NULL;
+        }
+        
+        // a level holds at most 2^level free blocks, more means a cycle
+        if (node != NULL && chk->index >= computer_pwr2(chk->level)) {
+            k_mem_check_report(chk->mpid, node, "free list cycle");
+            errors++;
+            node = NULL;
+        }
+        if (node == NULL) {
+            chk->index = 0;
+            chk->tree = (++chk->level == pool->num_levels);
+            continue;
+        }
+        errors += k_mem_check_node(chk->mpid, chk->level, node);
+        chk->index++;
+    }
+    return errors;
+}
+
+/**
+ * @brief   give cached memory back to the buddy free lists of a pool
+ * @return  number of blocks given back
+ */
+int k_mpool_reclaim(mpool_t mpid)
+{
+    int freed = (mpid == MPID_IRAM2) ? k_stack_pool_flush() + k_kstack_reclaim() : 0;
+    
+    freed += k_slab_reclaim(mpid);
+    freed += k_mpool_lazy_flush(mpid, -1);
+    if (mpid == MPID_IRAM1) {
+        freed += k_mem_zcache_flush();
+        freed += k_mem_compact(-1);
+    }
+    return freed;
+}
+
+/**
+ * @brief   buddy level of the allocated block at ptr
+ * @param   tree_index  set to the tree node of the block
+ */
+static int k_mpool_blk_level(MPOOL *pool, void *ptr, unsigned int *tree_index)
+{
+    // the lowest tree node marked 1 on the path up from the granule is the block
+    int x = ((U32)ptr - pool->start) >> MIN_BLK_SIZE_LOG2;
+    int k = pool->num_levels - 1;
+    while ((pool->tree[x + computer_pwr2(k) - 1] != 1) && (k > 0)) {
+        k--;
+        x = x/2;
+    }
+    *tree_index = x + computer_pwr2(k) - 1;
+    return k;
+}
+
+static void k_mpool_list_remove(DLIST *list, DNODE *node)
+{
+    // the prev link of a head node is not always cleared, test the head instead
+    if (list->head == node) {
+        list->head = node->next;
+    } else {
+        node->prev->next = node->next;
+    }
+    if (node->next != NULL) {
+        node->next->prev = (list->head == node->next) ? NULL : node->prev;
+    }
+}
+
+/**
+ * @brief   move unlocked handle blocks so that their buddies can coalesce
+ * @param   budget  max number of blocks to move, negative for all
+ * @return  number of blocks moved
+ * @note    a block is moved only if its buddy is free and a free block of
+ *          the same order exists below it, the lowest such block is taken,
+ *          so every move merges one pair and blocks slide to the pool start
+ */
+int k_mem_compact(int budget)
+{
+    MPOOL *pool = &g_mpools[MPID_IRAM1];
+    int moved = 0;
+    
+    for (int h = 0; h < MAX_MHANDLES && (budget < 0 || moved < budget); h++) {
+        MHANDLE *p_hdl = &g_mhandles[h];
+        if (p_hdl->ptr == NULL || p_hdl->locks > 0) {
+            continue;
+        }
+        
+        unsigned int pos;
+        int k = k_mpool_blk_level(pool, p_hdl->ptr, &pos);
+        if (k == 0) {
+            continue;
+        }
+        unsigned int buddy = (pos & 1) ? pos + 1 : pos - 1;
+        if (pool->tree[buddy] != 0) {
+            continue;   // nothing to merge with
+        }
+        
+        DNODE *dst = NULL;
+        for (DNODE *node = pool->list[k].head; node != NULL; node = node->next) {
+            if (node->treepos != buddy && (void *)node < p_hdl->ptr &&
+                (dst == NULL || node < dst)) {
+                dst = node;
+            }
+        }
+        if (dst == NULL) {
+            continue;
+        }
+        
+        k_mpool_list_remove(&pool->list[k], dst);
+        pool->tree[dst->treepos] = 1;
+        pool->free_bytes -= computer_pwr2(pool->size_log2 - k);
+        
+        U32 *from = p_hdl->ptr;
+        U32 *to = (U32 *)dst;
+        for (int i = computer_pwr2(pool->size_log2 - k) >> 2; i > 0; i--) {
+            *to++ = *from++;
+        }
+        
+        U8 *owner = g_mem_owner;
+        owner[((U32)dst - RAM1_START) >> SLAB_MIN_SIZE_LOG2] = 
+            owner[((U32)p_hdl->ptr - RAM1_START) >> SLAB_MIN_SIZE_LOG2];
+        owner[((U32)p_hdl->ptr - RAM1_START) >> SLAB_MIN_SIZE_LOG2] = TID_UNK;
+#ifdef MEM_PROFILE
+        g_mem_site_of[((U32)dst - RAM1_START) >> SLAB_MIN_SIZE_LOG2] = 
+            g_mem_site_of[((U32)p_hdl->ptr - RAM1_START) >> SLAB_MIN_SIZE_LOG2];
+        g_mem_site_of[((U32)p_hdl->ptr - RAM1_START) >> SLAB_MIN_SIZE_LOG2] = 0;
+#endif /* MEM_PROFILE */
+        
+        void *old = p_hdl->ptr;
+        p_hdl->ptr = dst;
+        k_mpool_free(MPID_IRAM1, old, FALSE);
+        moved++;
+    }
+    return moved;
+}
+
+/*
+ *===========================================================================
+ *                            SLAB LAYER
+ *===========================================================================
+ */
+
+static U8 *k_slab_page_map(mpool_t mpid, void *ptr)
+{
+    MPOOL *pool = &g_mpools[mpid];
+    
+    if (!k_mpool_valid(mpid) || (U32)ptr < pool->start || (U32)ptr > pool->end) {
+        return NULL;
+    }
+    return &pool->slab_pages[((U32)ptr - pool->start) >> pool->slab_log2];
+}
+
+static int k_slab_class(size_t size)
+{
+    if (size <= (1 << SLAB_MIN_SIZE_LOG2)) {
+        return 0;
+    }
+    return find_log(size) - SLAB_MIN_SIZE_LOG2;
+}
+
+static U16 k_slab_capacity(mpool_t mpid, SLAB *slab)
+{
+    return (computer_pwr2(g_mpools[mpid].slab_log2) - SLAB_HDR_SIZE) / slab->obj_size;
+}
+
+/**
+ * @brief   slab page holding ptr, pools are aligned to their size
+ */
+static SLAB *k_slab_of(mpool_t mpid, void *ptr)
+{
+    return (SLAB *)((U32)ptr & ~(computer_pwr2(g_mpools[mpid].slab_log2) - 1));
+}
+
+static void k_slab_unlink(SLAB_CACHE *cache, SLAB *slab)
+{
+    SLAB **pp = &cache->partial;
+    while (*pp != slab) {
+        pp = &(*pp)->next;
+    }
+    *pp = slab->next;
+}
+
+static void *k_slab_cache_alloc(mpool_t mpid, int cls)
+{
+    SLAB_CACHE *cache = &g_slab_caches[mpid][cls];
+    SLAB *slab = cache->partial;
+    
+    if (slab == NULL) {
+        slab = k_mpool_alloc_blk(mpid, computer_pwr2(g_mpools[mpid].slab_log2));
+        if (slab == NULL) {
+            return NULL;    // errno set by the buddy allocator
+        }
+        *k_slab_page_map(mpid, slab) = 1;
+        slab->obj_size = 1 << (cls + SLAB_MIN_SIZE_LOG2);
+        slab->free = NULL;
+        slab->nfree = k_slab_capacity(mpid, slab);
+        // thread from the last object so the free list starts at the lowest one
+        for (int i = slab->nfree - 1; i >= 0; i--) {
+            void **obj = (void **)((U8 *)slab + SLAB_HDR_SIZE + i * slab->obj_size);
+            *obj = slab->free;
+            slab->free = obj;
+        }
+        slab->next = NULL;
+        cache->partial = slab;
+    }
+    
+    void **obj = slab->free;
+    slab->free = *obj;
+    if (--slab->nfree == 0) {
+        cache->partial = slab->next;    // full pages are not tracked
+    }
+    return obj;
+}
+
+static void k_slab_cache_free(mpool_t mpid, void *ptr)
+{
+    SLAB *slab = k_slab_of(mpid, ptr);
+    SLAB_CACHE *cache = &g_slab_caches[mpid][k_slab_class(slab->obj_size)];
+    
+    *(void **)ptr = slab->free;
+    slab->free = ptr;
+    if (slab->nfree++ == 0) {
+        slab->next = cache->partial;
+        cache->partial = slab;
+    }
+    
+    // an empty page goes back to buddy unless it is the last one of its class,
+    // on the small user heap it always goes back
+    if (slab->nfree == k_slab_capacity(mpid, slab) &&
+        (mpid == MPID_IRAM1 || cache->partial != slab || slab->next != NULL)) {
+        k_slab_unlink(cache, slab);
+        *k_slab_page_map(mpid, slab) = 0;
+        k_mpool_free(mpid, slab, TRUE);
+    }
+}
+
+/**
+ * @brief   magazines of a task, allocated from MPID_IRAM2 on first use
+ * @return  SLAB_NUM_CLASSES magazines, NULL if there is no memory for them
+ */
+static MAGAZINE *k_slab_mags(TCB *p_tcb)
+{
+    if (p_tcb->mags == NULL) {
+        p_tcb->mags = k_slab_alloc(MPID_IRAM2, sizeof(MAGAZINE) * SLAB_NUM_CLASSES);
+        if (p_tcb->mags != NULL) {
+            for (int cls = 0; cls < SLAB_NUM_CLASSES; cls++) {
+                p_tcb->mags[cls].count = 0;
+            }
+        }
+    }
+    return p_tcb->mags;
+}
+
+/**
+ * @brief   allocate an object of at most slab_max bytes of the pool
+ * @note    MPID_IRAM1 objects come from the running task's magazine first
+ */
+void *k_slab_alloc(mpool_t mpid, size_t size)
+{
+    if (!k_mpool_valid(mpid)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    
+    int cls = k_slab_class(size);
+    
+    if (mpid == MPID_IRAM1 && gp_current_task != NULL && gp_current_task->mags != NULL) {
+        MAGAZINE *mag = &gp_current_task->mags[cls];
+        if (mag->count > 0) {
+            return mag->rounds[--mag->count];
+        }
+    }
+    return k_slab_cache_alloc(mpid, cls);
+}
+
+/**
+ * @brief   free an object allocated by k_slab_alloc
+ * @pre     k_slab_owns(mpid, ptr) is TRUE
+ */
+int k_slab_free(mpool_t mpid, void *ptr)
+{
+    SLAB *slab = k_slab_of(mpid, ptr);
+    
+    if ((void *)slab == ptr) {  // the page header is never handed out
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    
+    if (mpid == MPID_IRAM1 && gp_current_task != NULL && k_slab_mags(gp_current_task) != NULL) {
+        MAGAZINE *mag = &gp_current_task->mags[k_slab_class(slab->obj_size)];
+        if (mag->count < MAG_SIZE) {
+            mag->rounds[mag->count++] = ptr;
+            return RTX_OK;
+        }
+    }
+    k_slab_cache_free(mpid, ptr);
+    return RTX_OK;
+}
+
+/**
+ * @brief   check whether ptr lies in a slab page of the pool
+ */
+BOOL k_slab_owns(mpool_t mpid, void *ptr)
+{
+    U8 *map = k_slab_page_map(mpid, ptr);
+    return (map != NULL && *map != 0);
+}
+
+/**
+ * @brief   return the objects cached in a task's magazines to their pages
+ *          and the magazines to MPID_IRAM2
+ */
+void k_slab_flush_task(task_t tid)
+{
+    TCB *p_tcb = g_tcbs[tid];
+    
+    if (p_tcb == NULL || p_tcb->mags == NULL) {
+        return;
+    }
+    for (int cls = 0; cls < SLAB_NUM_CLASSES; cls++) {
+        MAGAZINE *mag = &p_tcb->mags[cls];
+        while (mag->count > 0) {
+            k_slab_cache_free(MPID_IRAM1, mag->rounds[--mag->count]);
+        }
+    }
+    k_slab_free(MPID_IRAM2, p_tcb->mags);
+    p_tcb->mags = NULL;
+}
+
+/**
+ * @brief   drain all magazines and give empty slab pages back to buddy
+ * @return  number of pages given back
+ */
+int k_slab_reclaim(mpool_t mpid)
+{
+    int freed = 0;
+    
+    if (!k_mpool_valid(mpid)) {
+        return 0;
+    }
+    
+    if (mpid == MPID_IRAM1) {
+        for (int tid = 0; tid < MAX_TASKS; tid++) {
+            k_slab_flush_task(tid);
+        }
+    }
+    
+    for (int cls = 0; cls < SLAB_NUM_CLASSES; cls++) {
+        SLAB **pp = &g_slab_caches[mpid][cls].partial;
+        while (*pp != NULL) {
+            SLAB *slab = *pp;
+            if (slab->nfree == k_slab_capacity(mpid, slab)) {
+                *pp = slab->next;
+                *k_slab_page_map(mpid, slab) = 0;
+                k_mpool_free(mpid, slab, FALSE);
+                freed++;
+            } else {
+                pp = &slab->next;
+            }
+        }
+    }
+    return freed;
+}
+
+int k_mpool_dump (mpool_t mpid)
+{
+#ifdef DEBUG_0
+    printf("k_mpool_dump: mpid = %d\r\n", mpid);
+#endif /* DEBUG_0 */
+    if (!k_mpool_valid(mpid))
+	{
+        errno = EINVAL;
+        return NULL;
+    }
+    int total = 0;
+    unsigned long size = 0;
+		
+		DLIST *list = g_mpools[mpid].list; //list to use
+		LAZYLIST *lazy = g_mpools[mpid].lazy; //deferred blocks to use
+		int log_size = g_mpools[mpid].size_log2;
+		int max_lvls = g_mpools[mpid].num_levels;
+		for (int k = 0; k < max_lvls; k++)
+		{
+			DNODE *temp = list[k].head;
+			
+			while(temp!=NULL)
+			{
+				size = computer_pwr2(log_size-k);
+				printf("0x%x: 0x%x\r\n", temp, size);
+				total++;
+				temp=temp->next;	
+			}
+			
+			// deferred blocks are free as well, just not coalesced yet
+			temp = lazy[k].head;
+			while(temp!=NULL)
+			{
+				size = computer_pwr2(log_size-k);
+				printf("0x%x: 0x%x\r\n", temp, size);
+				total++;
+				temp=temp->next;
+			}
+			
+			// so are the pre-zeroed ones
+			temp = (mpid == MPID_IRAM1) ? g_zcache[k].head : NULL;
+			while(temp!=NULL)
+			{
+				size = computer_pwr2(log_size-k);
+				printf("0x%x: 0x%x\r\n", temp, size);
+				total++;
+				temp=temp->next;
+			}
+		}
+		printf("%d free memory block(s) found\r\n", total);
+    return total;
+}
+
+static void k_mpool_dump_flush(HEAP_DUMP_OUT *out)
+{
+    for (U32 i = 0; i < out->len; i++) {
+        printf("%02x", out->buf[i]);
+    }
+    out->len = 0;
+}
+
+static void k_mpool_dump_put(HEAP_DUMP_OUT *out, U8 byte)
+{
+    if (out->stream && out->len == out->size) {
+        k_mpool_dump_flush(out);
+    }
+    if (out->len < out->size) {
+        out->buf[out->len++] = byte;
+    }
+    out->total++;
+}
+
+/**
+ * @brief   deferred and pre-zeroed blocks are free but marked used in the tree
+ */
+static BOOL k_mpool_dump_parked(mpool_t mpid, int k, void *blk)
+{
+    DNODE *node;
+    
+    for (node = g_mpools[mpid].lazy[k].head; node != NULL; node = node->next) {
+        if (node == blk) {
+            return TRUE;
+        }
+    }
+    for (node = (mpid == MPID_IRAM1) ? g_zcache[k].head : NULL; node != NULL; node = node->next) {
+        if (node == blk) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * @brief   compact binary dump of a pool
+ * @param   buf     output buffer, NULL to stream the dump to the UART as
+ *                  one "heap dump: " line of hex in HEAP_DUMP_CHUNK pieces
+ * @return  dump length in bytes, RTX_ERR if it does not fit in size bytes
+ * @note    format, multi-byte fields little endian:
+ *          U16 HEAP_DUMP_MAGIC, U8 HEAP_DUMP_VERSION, U8 mpid,
+ *          U8 size_log2, U8 num_levels, U32 start,
+ *          then the blocks in address order as runs of two bytes:
+ *          U8 tag (HEAP_DUMP_FREE | level), U8 number of blocks - 1
+ */
+int k_mpool_dump_bin(mpool_t mpid, U8 *buf, U32 size)
+{
+    U8 chunk[HEAP_DUMP_CHUNK];
+    HEAP_DUMP_OUT out;
+    
+    if (!k_mpool_valid(mpid)) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    out.stream = (buf == NULL);
+    out.buf = out.stream ? chunk : buf;
+    out.size = out.stream ? HEAP_DUMP_CHUNK : size;
+    out.len = 0;
+    out.total = 0;
+    
+    MPOOL *pool = &g_mpools[mpid];
+    U32 hdr[] = { HEAP_DUMP_MAGIC, HEAP_DUMP_MAGIC >> 8, HEAP_DUMP_VERSION, mpid,
+                  pool->size_log2, pool->num_levels,
+                  pool->start, pool->start >> 8, pool->start >> 16, pool->start >> 24 };
+    
+    if (out.stream) {
+        printf("heap dump: ");
+    }
+    for (int i = 0; i < sizeof(hdr) / sizeof(hdr[0]); i++) {
+        k_mpool_dump_put(&out, hdr[i]);
+    }
+    
+    U8 run_tag = 0;
+    int run_len = 0;
+    for (U32 x = 0; x < computer_pwr2(pool->size_log2); ) {
+        // descend to the block holding offset x, a split node has a used child
+        int k = 0;
+        int pos = 0;
+        while (pool->tree[pos] == 1 && k < pool->num_levels - 1 &&
+               (pool->tree[2 * pos + 1] != 0 || pool->tree[2 * pos + 2] != 0)) {
+            k++;
+            pos = 2 * pos + 1 + ((x >> (pool->size_log2 - k)) & 0x1);
+        }
+        
+        BOOL is_free = (pool->tree[pos] == 0 ||
+                        k_mpool_dump_parked(mpid, k, (void *)(pool->start + x)));
+        U8 tag = (is_free ? HEAP_DUMP_FREE : 0) | k;
+        
+        if (run_len > 0 && tag == run_tag && run_len < 0x100) {
+            run_len++;
+        } else {
+            if (run_len > 0) {
+                k_mpool_dump_put(&out, run_tag);
+                k_mpool_dump_put(&out, run_len - 1);
+            }
+            run_tag = tag;
+            run_len = 1;
+        }
+        x += computer_pwr2(pool->size_log2 - k);
+    }
+    k_mpool_dump_put(&out, run_tag);
+    k_mpool_dump_put(&out, run_len - 1);
+    
+    if (out.stream) {
+        k_mpool_dump_flush(&out);
+        printf("\r\n");
+    } else if (out.total > size) {
+        errno = ENOSPC;
+        return RTX_ERR;
+    }
+    return out.total;
+}
+ 
+int k_mem_init(int algo)
+{
+#ifdef DEBUG_0
+    printf("k_mem_init: algo = %d\r\n", algo);
+#endif /* DEBUG_0 */
+    
+    for (mpool_t mpid = 0; mpid < NUM_MPOOLS; mpid++) {
+        g_mpools[mpid].active = FALSE;
+    }
+        
+    if ( k_mpool_create(algo, RAM1_START, RAM1_END) < 0 ) {
+        return RTX_ERR;
+    }
+    
+    if ( k_mpool_create(algo, RAM2_START, RAM2_END) < 0 ) {
+        return RTX_ERR;
+    }
+    
+    return RTX_OK;
+}
+
+/**
+ * @brief   number of bytes a request of size bytes takes from a pool
+ */
+static U32 k_mem_charge(size_t size)
+{
+    if (size <= (1 << SLAB_MIN_SIZE_LOG2)) {
+        return 1 << SLAB_MIN_SIZE_LOG2;     // smallest slab class
+    }
+    return computer_pwr2(find_log(size));   // slab class or buddy block
+}
+
+/**
+ * @brief   bytes taken by the allocated block at ptr
+ */
+static U32 k_mpool_blk_size(mpool_t mpid, void *ptr)
+{
+    MPOOL *pool = &g_mpools[mpid];
+    unsigned int pos;
+    
+    if (k_slab_owns(mpid, ptr)) {
+        return k_slab_of(mpid, ptr)->obj_size;
+    }
+    return computer_pwr2(pool->size_log2 - k_mpool_blk_level(pool, ptr, &pos));
+}
+
+/**
+ * @brief   check a MPID_IRAM1 request against the task quota and the reserve
+ */
+static BOOL k_mem_over_quota(TCB *p_tcb, U32 charge)
+{
+    if (p_tcb->mem_quota != 0 && p_tcb->mem_used + charge > p_tcb->mem_quota) {
+        return TRUE;
+    }
+    // below MEM_RESERVE_PRIO a task may not dig into the reserve, which is
+    // measured against what the buddy layer really has left, so slab pages,
+    // caches and fragmentation count as used
+    if (MEM_RESERVE_SIZE != 0 && p_tcb->prio > MEM_RESERVE_PRIO &&
+        g_mpools[MPID_IRAM1].free_bytes < charge + MEM_RESERVE_SIZE) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+#ifdef DEBUG_HEAP
+/**
+ * @brief   check that ptr is the start of an allocated block of the pool
+ * @note    a pointer into a split node lies in free space below it
+ */
+static BOOL k_mpool_blk_start(mpool_t mpid, void *ptr)
+{
+    MPOOL *pool = &g_mpools[mpid];
+    unsigned int pos;
+    
+    if ((U32)ptr < pool->start || (U32)ptr > pool->end) {
+        return FALSE;
+    }
+    
+    if (k_slab_owns(mpid, ptr)) {
+        SLAB *slab = k_slab_of(mpid, ptr);
+        U32 offset = (U32)ptr - (U32)slab - SLAB_HDR_SIZE;
+        return ((U32)ptr >= (U32)slab + SLAB_HDR_SIZE && 
+                offset % slab->obj_size == 0 &&
+                offset / slab->obj_size < k_slab_capacity(mpid, slab));
+    }
+    
+    int k = k_mpool_blk_level(pool, ptr, &pos);
+    if (pool->tree[pos] != 1 || 
+        (((U32)ptr - pool->start) & (computer_pwr2(pool->size_log2 - k) - 1))) {
+        return FALSE;
+    }
+    return (k == pool->num_levels - 1 || 
+            (pool->tree[2 * pos + 1] == 0 && pool->tree[2 * pos + 2] == 0));
+}
+
+static void k_heap_dbg_report(char *what, void *ptr, HEAP_DBG_HDR *hdr)
+{
+    printf("heap debug: %s at 0x%x, freed by tid %d pc 0x%x", 
+           what, ptr, k_tsk_gettid(), g_svc_caller_pc);
+    if (hdr != NULL) {
+        printf(", allocated by tid %d pc 0x%x", hdr->tid, hdr->pc);
+    }
+    printf("\r\n");
+}
+
+/**
+ * @brief   fill in the header and trailer of a debug block
+ * @return  the user pointer, NULL if blk is NULL
+ */
+static void *k_heap_dbg_arm(void *blk, size_t size)
+{
+    HEAP_DBG_HDR *hdr = blk;
+    U32 canary = HEAP_CANARY;
+    
+    if (hdr == NULL) {
+        return NULL;
+    }
+    hdr->size = size;
+    hdr->pc = g_svc_caller_pc;
+    hdr->tid = gp_current_task->tid;
+    hdr->canary = HEAP_CANARY;
+    
+    // the trailer follows the user bytes and may be unaligned
+    U8 *trailer = (U8 *)(hdr + 1) + size;
+    for (int i = 0; i < HEAP_DBG_TRAILER; i++) {
+        trailer[i] = ((U8 *)&canary)[i];
+    }
+    return hdr + 1;
+}
+
+/**
+ * @brief   validate a debug block being freed and poison it
+ * @return  the block to give back, NULL if ptr is not a live debug block,
+ *          ptr itself if it is not user heap memory at all
+ */
+static void *k_heap_dbg_disarm(void *ptr)
+{
+    HEAP_DBG_HDR *hdr = (HEAP_DBG_HDR *)ptr - 1;
+    U32 canary = HEAP_CANARY;
+    mpool_t mpid = k_mpool_find(ptr);
+    
+    if (mpid != MPID_IRAM1 && mpid < MAX_MPOOLS &&
+        !(mpid == MPID_IRAM2 && k_mem_dma_marked(hdr))) {
+        return ptr;     // rejected by k_mem_dealloc
+    }
+    if (k_mpool_find(hdr) != mpid) {
+        k_heap_dbg_report("not an allocated block", ptr, NULL);
+        return NULL;
+    }
+    if (hdr->canary == HEAP_CANARY_FREED) {
+        k_heap_dbg_report("double free", ptr, hdr);
+        return NULL;
+    }
+    if (!k_mpool_blk_start(mpid, hdr)) {
+        k_heap_dbg_report("not an allocated block", ptr, NULL);
+        return NULL;
+    }
+    if (hdr->canary != HEAP_CANARY) {
+        k_heap_dbg_report("header canary overwritten", ptr, NULL);
+        return NULL;
+    }
+    
+    U8 *trailer = (U8 *)ptr + hdr->size;
+    for (int i = 0; i < HEAP_DBG_TRAILER; i++) {
+        if (trailer[i] != ((U8 *)&canary)[i]) {
+            k_heap_dbg_report("overrun", ptr, hdr);
+            return NULL;
+        }
+    }
+    
+    for (U32 i = 0; i < hdr->size + HEAP_DBG_TRAILER; i++) {
+        ((U8 *)ptr)[i] = HEAP_POISON;
+    }
+    hdr->canary = HEAP_CANARY_FREED;
+    return hdr;
+}
+#endif /* DEBUG_HEAP */
+
+#ifdef MEM_PROFILE
+/**
+ * @brief   charge a new MPID_IRAM1 block to the SVC call site being served
+ */
+static void k_mem_prof_alloc(void *ptr, U32 charge)
+{
+    U32 pc = g_svc_caller_pc;
+    int i = ((pc >> 1) ^ (pc >> 7)) & (PROF_SITES - 1);
+    int n;
+    
+    // linear probing, sites are never removed so a free slot ends the search
+    for (n = 0; n < PROF_SITES; n++, i = (i + 1) & (PROF_SITES - 1)) {
+        if (g_mem_sites[i].pc == pc || g_mem_sites[i].pc == 0) {
+            break;
+        }
+    }
+    if (n == PROF_SITES) {
+        g_mem_prof_lost++;
+        return;
+    }
+    
+    MEM_SITE *site = &g_mem_sites[i];
+    if (site->pc == 0) {
+        site->pc = pc;
+        site->count = 0;
+        site->live = 0;
+        site->peak = 0;
+    }
+    site->count++;
+    site->live += charge;
+    if (site->live > site->peak) {
+        site->peak = site->live;
+    }
+    g_mem_site_of[((U32)ptr - RAM1_START) >> SLAB_MIN_SIZE_LOG2] = i + 1;
+}
+
+static void k_mem_prof_free(void *ptr, U32 charge)
+{
+    U8 *site_of = &g_mem_site_of[((U32)ptr - RAM1_START) >> SLAB_MIN_SIZE_LOG2];
+    
+    if (*site_of != 0) {
+        MEM_SITE *site = &g_mem_sites[*site_of - 1];
+        site->live = (site->live > charge) ? site->live - charge : 0;
+        *site_of = 0;
+    }
+}
+
+/**
+ * @brief   print the call site table, one line per site
+ * @return  number of sites printed
+ */
+int k_mem_prof_dump(void)
+{
+    int num = 0;
+    
+    printf("mem prof: %d site(s) lost\r\n", g_mem_prof_lost);
+    for (int i = 0; i < PROF_SITES; i++) {
+        MEM_SITE *site = &g_mem_sites[i];
+        if (site->pc != 0) {
+            printf("mem prof: 0x%x: allocs %d, live %d, peak %d\r\n",
+                   site->pc, site->count, site->live, site->peak);
+            num++;
+        }
+    }
+    return num;
+}
+#endif /* MEM_PROFILE */
+
+/**
+ * @brief   recompute the MPID_IRAM1 pressure level and wake the tasks
+ *          waiting for it
+ * @param   failed  TRUE if an allocation just ran out of memory
+ * @return  TRUE if the running task was switched out for a woken task
+ * @note    after a failed allocation woken tasks of the caller's priority
+ *          run first too, so a cache owner can shrink before ENOMEM
+ * @note    with K_SHARED_STACK the caller's SVC cannot be suspended, woken
+ *          tasks wait for the next scheduling point
+ */
+static BOOL k_mem_pressure_update(BOOL failed)
+{
+    U32 avail = g_mpools[MPID_IRAM1].free_bytes;   // slab pages and caches count as used
+    U8 old = g_mem_pressure;
+    U8 prio = PRIO_NULL;    // best priority woken
+    
+    // pre-zeroed blocks are only worth parking while memory is plentiful
+    if (avail < ZERO_CACHE_HEADROOM && k_mem_zcache_flush() != 0) {
+        avail = g_mpools[MPID_IRAM1].free_bytes;
+    }
+    if (failed) {
+        g_mem_pressure = MEM_PRESSURE_CRITICAL;
+    } else if (avail < MEM_WMARK_HIGH) {
+        g_mem_pressure = MEM_PRESSURE_HIGH;
+    } else if (avail < MEM_WMARK_LOW) {
+        g_mem_pressure = MEM_PRESSURE_LOW;
+    } else {
+        g_mem_pressure = MEM_PRESSURE_NONE;
+    }
+    
+    // a waiter blocked below the level it waits for, only a change wakes it
+    if (g_mem_waiters == 0 || g_mem_pressure == old) {
+        return FALSE;
+    }
+    for (int i = 0; i < MAX_TASKS; i++) {
+        TCB *p_tcb = g_tcbs[i];
+        if (p_tcb != NULL && p_tcb->state == BLK_MEM && g_mem_pressure >= p_tcb->mem_wait) {
+            p_tcb->state = READY;
+            p_tcb->mem_wait = MEM_PRESSURE_NONE;
+#ifdef K_SHARED_STACK
+            k_tsk_set_ret(p_tcb, g_mem_pressure);   // mem_pressure_wait result
+#endif /* K_SHARED_STACK */
+            push_back(&(array_of_queue[PRIO_QUEUE(p_tcb->prio)]), p_tcb->tid);
+            g_mem_waiters--;
+            if (p_tcb->prio < prio) {
+                prio = p_tcb->prio;
+            }
+        }
+    }
+    
+#ifdef K_SHARED_STACK
+    return FALSE;
+#else
+    // an exiting task is not requeued, its k_tsk_run_new picks the woken
+    if (gp_current_task->tid == TID_NULL || gp_current_task->state != RUNNING ||
+        prio > gp_current_task->prio) {
+        return FALSE;
+    }
+    if (prio < gp_current_task->prio) {
+        push_front(&(array_of_queue[PRIO_QUEUE(gp_current_task->prio)]), gp_current_task->tid);
+    } else if (failed) {
+        push_back(&(array_of_queue[PRIO_QUEUE(gp_current_task->prio)]), gp_current_task->tid);
+    } else {
+        return FALSE;
+    }
+    k_tsk_run_new();
+    return TRUE;
+#endif /* K_SHARED_STACK */
+}
+
+/**
+ * @brief   MPID_IRAM1 block for k_mem_alloc_user, uncharged
+ */
+static void *k_mem_alloc_iram1(size_t size, BOOL movable, BOOL zeroed)
+{
+    void *ptr = NULL;
+    
+    if (zeroed) {
+        ptr = k_mem_zcache_pop(size);
+    }
+    
+    if (ptr != NULL) {
+        // pre-zeroed hit
+    } else if (movable) {
+        ptr = k_mpool_alloc_blk(MPID_IRAM1, size);
+        if (ptr == NULL && errno == ENOMEM && k_mpool_reclaim(MPID_IRAM1) > 0) {
+            ptr = k_mpool_alloc_blk(MPID_IRAM1, size);
+        }
+    } else {
+        ptr = k_mpool_alloc(MPID_IRAM1, size);
+        if (ptr != NULL && zeroed) {
+            k_mem_zero(ptr, size);
+        }
+    }
+    return ptr;
+}
+
+/**
+ * @brief   charged MPID_IRAM1 allocation for the running task
+ * @param   movable TRUE to bypass the slab layer, only whole buddy blocks
+ *                  can be moved by the compactor
+ * @param   zeroed  TRUE to return zero filled memory
+ */
+static void *k_mem_alloc_user(size_t size, BOOL movable, BOOL zeroed)
+{
+    U32 charge = k_mem_charge(size);
+    void *ptr = NULL;
+    
+    if (movable && charge < MIN_BLK_SIZE) {
+        charge = MIN_BLK_SIZE;
+    }
+    if (k_mem_over_quota(gp_current_task, charge)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    ptr = k_mem_alloc_iram1(size, movable, zeroed);
+    
+    // kernel caches are already reclaimed, let woken cache owners shrink
+    if (ptr == NULL && errno == ENOMEM && k_mem_pressure_update(TRUE)) {
+        ptr = k_mem_alloc_iram1(size, movable, zeroed);
+    }
+    
+    if (ptr != NULL) {
+        gp_current_task->mem_used += charge;
+        g_mem_owner[((U32)ptr - RAM1_START) >> SLAB_MIN_SIZE_LOG2] = k_tsk_tag(gp_current_task->tid);
+#ifdef MEM_PROFILE
+        k_mem_prof_alloc(ptr, charge);
+#endif /* MEM_PROFILE */
+        k_mem_pressure_update(FALSE);
+    }
+    return ptr;
+}
+
+/**
+ * @brief   mem_alloc, served from the running task's private heap first
+ *          and from MPID_IRAM1 if the private heap is exhausted
+ * @note    only MPID_IRAM1 memory counts against quotas
+ */
+static void *k_mem_alloc_plain(size_t size)
+{
+    mpool_t heap = gp_current_task->heap;
+    
+    if (heap != MPID_NONE) {
+        void *ptr = k_mpool_alloc(heap, size);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    
+    if (size == 0) {
+        return NULL;
+    }
+    return k_mem_alloc_user(size, FALSE, FALSE);
+}
+
+void *k_mem_alloc(size_t size)
+{
+#ifdef DEBUG_HEAP
+    if (size == 0 || size + HEAP_DBG_OVERHEAD < size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return k_heap_dbg_arm(k_mem_alloc_plain(size + HEAP_DBG_OVERHEAD), size);
+#else
+    return k_mem_alloc_plain(size);
+#endif /* DEBUG_HEAP */
+}
+
+/**
+ * @brief   mark or unmark the MPID_IRAM2 block at ptr as a mem_alloc_flags block
+ */
+static void k_mem_dma_mark(void *ptr, BOOL marked)
+{
+    U32 i = ((U32)ptr - RAM2_START) >> SLAB_MIN_SIZE_LOG2;
+    
+    if (marked) {
+        g_mem_dma_map[i >> 3] |= 1 << (i & 7);
+    } else {
+        g_mem_dma_map[i >> 3] &= ~(1 << (i & 7));
+    }
+}
+
+/**
+ * @brief   TRUE if ptr is the start of a mem_alloc_flags MPID_IRAM2 block
+ */
+static BOOL k_mem_dma_marked(void *ptr)
+{
+    U32 i = ((U32)ptr - RAM2_START) >> SLAB_MIN_SIZE_LOG2;
+    
+    if ((U32)ptr < RAM2_START || (U32)ptr > RAM2_END ||
+        ((U32)ptr & ((1 << SLAB_MIN_SIZE_LOG2) - 1)) != 0) {
+        return FALSE;
+    }
+    return (g_mem_dma_map[i >> 3] >> (i & 7)) & 1;
+}
+
+/**
+ * @brief   AHB SRAM for the running task, from its private heap first
+ *          and from MPID_IRAM2 up to MEM_DMA_LIMIT bytes
+ */
+static void *k_mem_alloc_dma(size_t size)
+{
+    mpool_t heap = gp_current_task->heap;
+    void *ptr;
+    
+    if (heap != MPID_NONE) {
+        ptr = k_mpool_alloc(heap, size);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    
+    if (g_mem_dma_used + k_mem_charge(size) > MEM_DMA_LIMIT) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    ptr = k_mpool_alloc(MPID_IRAM2, size);
+    if (ptr != NULL) {
+        g_mem_dma_used += k_mpool_blk_size(MPID_IRAM2, ptr);
+        k_mem_dma_mark(ptr, TRUE);
+    }
+    return ptr;
+}
+
+/**
+ * @brief   mem_alloc_flags without the DEBUG_HEAP wrapper
+ * @note    MEM_DMA | MEM_ANY may fall back to local SRAM, which the GPDMA
+ *          cannot reach, only use it for buffers the CPU copies
+ */
+static void *k_mem_alloc_flags_plain(size_t size, U32 flags)
+{
+    void *ptr;
+    
+    if (size == 0) {
+        return NULL;
+    }
+    if (flags & MEM_DMA) {
+        ptr = k_mem_alloc_dma(size);
+        if (ptr == NULL && (flags & MEM_ANY)) {
+            ptr = k_mem_alloc_user(size, FALSE, FALSE);
+        }
+    } else {
+        ptr = k_mem_alloc_user(size, FALSE, FALSE);
+        if (ptr == NULL && (flags & MEM_ANY)) {
+            ptr = k_mem_alloc_dma(size);
+        }
+    }
+    return ptr;
+}
+
+/**
+ * @brief   mem_alloc_flags, mem_alloc with a placement hint
+ * @param   flags   MEM_FAST or MEM_DMA, or-ed with MEM_ANY to fall back
+ *                  to the other SRAM, MEM_ANY alone prefers MEM_FAST
+ * @note    MEM_FAST memory counts against quotas, MEM_DMA memory does not
+ */
+void *k_mem_alloc_flags(size_t size, U32 flags)
+{
+    if ((flags & ~(MEM_FAST | MEM_DMA | MEM_ANY)) != 0 ||
+        (flags & (MEM_FAST | MEM_DMA)) == (MEM_FAST | MEM_DMA)) {
+        errno = EINVAL;
+        return NULL;
+    }
+#ifdef DEBUG_HEAP
+    if (size == 0 || size + HEAP_DBG_OVERHEAD < size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return k_heap_dbg_arm(k_mem_alloc_flags_plain(size + HEAP_DBG_OVERHEAD, flags), size);
+#else
+    return k_mem_alloc_flags_plain(size, flags);
+#endif /* DEBUG_HEAP */
+}
+
+/**
+ * @brief   zero filled k_mem_alloc_plain
+ * @note    MPID_IRAM1 blocks of the cached orders are zeroed ahead of time
+ *          by the null task, everything else is zeroed here
+ */
+static void *k_mem_calloc_plain(size_t total)
+{
+    mpool_t heap = gp_current_task->heap;
+    
+    if (heap != MPID_NONE) {
+        void *ptr = k_mpool_alloc(heap, total);
+        if (ptr != NULL) {
+            k_mem_zero(ptr, total);
+            return ptr;
+        }
+    }
+    return k_mem_alloc_user(total, FALSE, TRUE);
+}
+
+/**
+ * @brief   mem_calloc, zero filled mem_alloc of num objects of size bytes
+ */
+void *k_mem_calloc(size_t num, size_t size)
+{
+    size_t total = num * size;
+    
+    if (num != 0 && total / num != size) {
+        errno = ENOMEM;     // num * size overflows
+        return NULL;
+    }
+    if (total == 0) {
+        return NULL;
+    }
+#ifdef DEBUG_HEAP
+    if (total + HEAP_DBG_OVERHEAD < total) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return k_heap_dbg_arm(k_mem_calloc_plain(total + HEAP_DBG_OVERHEAD), total);
+#else
+    return k_mem_calloc_plain(total);
+#endif /* DEBUG_HEAP */
+}
+
+/**
+ * @brief   mem_dealloc, returns ptr to whichever heap it came from
+ */
+static int k_mem_dealloc_plain(void *ptr)
+{
+    mpool_t mpid = k_mpool_find(ptr);
+    if (mpid == MPID_IRAM2 && k_mem_dma_marked(ptr)) {
+        U32 size = k_mpool_blk_size(mpid, ptr);
+        if (k_mpool_dealloc(mpid, ptr) != RTX_OK) {
+            return RTX_ERR;
+        }
+        k_mem_dma_mark(ptr, FALSE);
+        g_mem_dma_used -= size;
+        return RTX_OK;
+    }
+    if (mpid != MPID_IRAM1 && mpid < MAX_MPOOLS) {
+        errno = EFAULT;     // not user heap memory
+        return RTX_ERR;
+    }
+    if (mpid != MPID_IRAM1) {
+        return k_mpool_dealloc(mpid, ptr);
+    }
+    
+    // credit the owner, which is not necessarily the caller
+    U8 *owner = &g_mem_owner[((U32)ptr - RAM1_START) >> SLAB_MIN_SIZE_LOG2];
+    U32 charge = k_mpool_blk_size(mpid, ptr);
+    
+    if (k_mpool_dealloc(mpid, ptr) != RTX_OK) {
+        return RTX_ERR;
+    }
+#ifdef MEM_PROFILE
+    k_mem_prof_free(ptr, charge);
+#endif /* MEM_PROFILE */
+    // an owner that has exited, even if its slot is reused, is not credited
+    TCB *p_tcb = k_tsk_lookup(*owner);
+    if (p_tcb != NULL) {
+        p_tcb->mem_used = (p_tcb->mem_used > charge) ? p_tcb->mem_used - charge : 0;
+    }
+    *owner = TID_UNK;
+    k_mem_pressure_update(FALSE);
+    return RTX_OK;
+}
+
+int k_mem_dealloc(void *ptr)
+{
+    if (ptr == NULL) {
+        return RTX_OK;
+    }
+    
+#ifdef DEBUG_HEAP
+    ptr = k_heap_dbg_disarm(ptr);
+    if (ptr == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+#endif /* DEBUG_HEAP */
+    return k_mem_dealloc_plain(ptr);
+}
+
+/**
+ * @brief   look up a handle of the running task
+ * @note    errno EINVAL for a bad handle, EPERM for another task's handle
+ */
+static MHANDLE *k_mhandle_get(mhandle_t handle)
+{
+    if (handle == MHANDLE_NULL || handle > MAX_MHANDLES ||
+        g_mhandles[handle - 1].ptr == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (g_mhandles[handle - 1].owner != k_tsk_tag(gp_current_task->tid)) {
+        errno = EPERM;
+        return NULL;
+    }
+    return &g_mhandles[handle - 1];
+}
+
+/**
+ * @brief   allocate a movable MPID_IRAM1 block
+ * @return  handle of the block, MHANDLE_NULL on failure
+ * @note    the block is charged like mem_alloc but never comes from a
+ *          private heap, it has to be locked before it is accessed
+ */
+mhandle_t k_mem_halloc(size_t size)
+{
+    int h;
+    
+    if (size == 0) {
+        errno = EINVAL;
+        return MHANDLE_NULL;
+    }
+    for (h = 0; h < MAX_MHANDLES; h++) {
+        if (g_mhandles[h].ptr == NULL) {
+            break;
+        }
+    }
+    if (h == MAX_MHANDLES) {
+        errno = ENOSPC;
+        return MHANDLE_NULL;
+    }
+    
+    void *ptr = k_mem_alloc_user(size, TRUE, FALSE);
+    if (ptr == NULL) {
+        return MHANDLE_NULL;    // errno set by k_mem_alloc_user
+    }
+    // a task woken by memory pressure may have run and taken slot h
+    while (h < MAX_MHANDLES && g_mhandles[h].ptr != NULL) {
+        h++;
+    }
+    if (h == MAX_MHANDLES) {
+        k_mem_dealloc_plain(ptr);
+        errno = ENOSPC;
+        return MHANDLE_NULL;
+    }
+    g_mhandles[h].ptr = ptr;
+    g_mhandles[h].locks = 0;
+    g_mhandles[h].owner = k_tsk_tag(gp_current_task->tid);
+    return h + 1;
+}
+
+/**
+ * @brief   free a movable block, it must not be locked
+ */
+int k_mem_hfree(mhandle_t handle)
+{
+    MHANDLE *p_hdl = k_mhandle_get(handle);
+    
+    if (p_hdl == NULL) {
+        return RTX_ERR;
+    }
+    if (p_hdl->locks > 0) {
+        errno = EAGAIN;
+        return RTX_ERR;
+    }
+    if (k_mem_dealloc_plain(p_hdl->ptr) != RTX_OK) {
+        return RTX_ERR;
+    }
+    p_hdl->ptr = NULL;
+    return RTX_OK;
+}
+
+/**
+ * @brief   free all movable blocks of an exiting task, locked or not
+ * @param   tag     k_tsk_tag of the task
+ */
+void k_mem_hfree_task(task_t tag)
+{
+    for (int h = 0; h < MAX_MHANDLES; h++) {
+        MHANDLE *p_hdl = &g_mhandles[h];
+        if (p_hdl->ptr != NULL && p_hdl->owner == tag) {
+            k_mem_dealloc_plain(p_hdl->ptr);
+            p_hdl->ptr = NULL;
+            p_hdl->locks = 0;
+        }
+    }
+}
+
+/**
+ * @brief   pin a movable block and return its current address
+ * @note    the address stays valid until the matching mem_unlock
+ */
+void *k_mem_lock(mhandle_t handle)
+{
+    MHANDLE *p_hdl = k_mhandle_get(handle);
+    
+    if (p_hdl == NULL) {
+        return NULL;
+    }
+    if (p_hdl->locks == MHANDLE_MAX_LOCKS) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    p_hdl->locks++;
+    return p_hdl->ptr;
+}
+
+int k_mem_unlock(mhandle_t handle)
+{
+    MHANDLE *p_hdl = k_mhandle_get(handle);
+    
+    if (p_hdl == NULL) {
+        return RTX_ERR;
+    }
+    if (p_hdl->locks == 0) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    p_hdl->locks--;
+    return RTX_OK;
+}
+
+/**
+ * @brief   set the MPID_IRAM1 quota of a task
+ * @param   quota   max bytes the task may hold, 0 for no limit
+ * @note    only privileged tasks may set quotas
+ */
+int k_mem_set_quota(task_t tid, U32 quota)
+{
+    TCB *p_tcb = (tid < MAX_TASKS) ? g_tcbs[tid] : NULL;
+    
+    if (p_tcb == NULL || p_tcb->state == DORMANT) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    if (gp_current_task->priv == 0) {
+        errno = EPERM;
+        return RTX_ERR;
+    }
+    p_tcb->mem_quota = quota;
+    return RTX_OK;
+}
+
+/**
+ * @brief   current MPID_IRAM1 pressure level, MEM_PRESSURE_NONE to
+ *          MEM_PRESSURE_CRITICAL
+ */
+int k_mem_pressure(void)
+{
+    return g_mem_pressure;
+}
+
+/**
+ * @brief   block the running task until MPID_IRAM1 pressure reaches level
+ * @return  the pressure level once woken, RTX_ERR on error
+ * @note    tasks holding caches wait here and shrink them when woken, a
+ *          failed allocation wakes MEM_PRESSURE_CRITICAL waiters before
+ *          it returns ENOMEM
+ */
+int k_mem_pressure_wait(U8 level)
+{
+    if (level == MEM_PRESSURE_NONE || level > MEM_PRESSURE_CRITICAL) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    if (gp_current_task->tid == TID_NULL) {
+        errno = EPERM;      // the null task must never block
+        return RTX_ERR;
+    }
+    
+    if (g_mem_pressure < level) {
+        gp_current_task->state = BLK_MEM;
+        gp_current_task->mem_wait = level;
+        g_mem_waiters++;
+        k_tsk_run_new();
+    }
+    return g_mem_pressure;
+}
+
+/**
+ * @brief   record which MPID_IRAM1 blocks are live and who owns them
+ */
+int k_mem_snapshot(MEM_SNAPSHOT *snap)
+{
+    if (snap == NULL) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    k_mem_zero(snap, sizeof(MEM_SNAPSHOT));
+    for (int i = 0; i < MEM_SNAP_GRANULES; i++) {
+        U8 tid = g_mem_owner[i];
+        if (tid != TID_UNK) {
+            snap->live[i >> 3] |= 1 << (i & 0x7);
+            snap->owner[i] = tid;
+        }
+    }
+    return RTX_OK;
+}
+
+/**
+ * @brief   print the MPID_IRAM1 blocks that are live now but were not live,
+ *          or had another owner, when snap was taken
+ * @return  number of such blocks, RTX_ERR on error
+ * @note    a block freed and allocated again at the same address by the
+ *          same task in between is not reported, a handle block moved by
+ *          the compactor is
+ */
+int k_mem_snapshot_diff(MEM_SNAPSHOT *snap)
+{
+    int num = 0;
+    
+    if (snap == NULL) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    for (int i = 0; i < MEM_SNAP_GRANULES; i++) {
+        U8 tag = g_mem_owner[i];
+        if (tag == TID_UNK) {
+            continue;
+        }
+        if (((snap->live[i >> 3] >> (i & 0x7)) & 0x1) &&
+            snap->owner[i] == tag) {
+            continue;
+        }
+        
+        void *ptr = (void *)(RAM1_START + (i << SLAB_MIN_SIZE_LOG2));
+        printf("mem snapshot: 0x%x: 0x%x bytes, tid %d\r\n",
+               ptr, k_mpool_blk_size(MPID_IRAM1, ptr), TID_OF_TAG(tag));
+        num++;
+    }
+    return num;
+}
+
+/**
+ * @brief   carve a private buddy heap out of PRIV_HEAP_MPID
+ * @param   size    heap size in bytes, rounded up to a power of two
+ * @return  pool id of the heap, RTX_ERR on failure with errno EINVAL if
+ *          size exceeds PRIV_HEAP_MPID, ENOMEM if no block is free and
+ *          EAGAIN if every private heap slot is taken
+ */
+mpool_t k_heap_create(size_t size)
+{
+    // checked before rounding, find_log of a huge size wraps to 0
+    if (size > computer_pwr2(g_mpools[PRIV_HEAP_MPID].size_log2)) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    U32 blk_size = computer_pwr2(find_log(size));
+    
+    if (blk_size < PRIV_HEAP_MIN_SIZE) {
+        blk_size = PRIV_HEAP_MIN_SIZE;
+    }
+    
+    U32 start = (U32) k_mpool_alloc(PRIV_HEAP_MPID, blk_size);
+    if (start == 0) {
+        return RTX_ERR;                 // errno set by k_mpool_alloc
+    }
+    
+    mpool_t mpid = k_mpool_create(BUDDY, start, start + blk_size - 1);
+    if (mpid < 0) {
+        int err = errno;                // k_mpool_dealloc may overwrite it
+        k_mpool_dealloc(PRIV_HEAP_MPID, (void *)start);
+        errno = err;
+        return RTX_ERR;
+    }
+    return mpid;
+}
+
+/**
+ * @brief   give a private heap back to PRIV_HEAP_MPID,
+ *          blocks still allocated from it are released as well
+ */
+int k_heap_destroy(mpool_t mpid)
+{
+    if (mpid < MAX_MPOOLS || !k_mpool_valid(mpid)) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    U32 start = g_mpools[mpid].start;
+    k_mpool_destroy(mpid);
+    return k_mpool_dealloc(PRIV_HEAP_MPID, (void *)start);
+}
+
+/**
+ * @brief   kernel stack of a task, carved from a KSTACK_PAGE_SIZE page of
+ *          MPID_IRAM2 so that KERN_STACK_SIZE need not be a power of two
+ * @return  top of the stack, NULL on failure
+ * @note    MPID_IRAM2 is 16KB aligned, so buddy pages are size aligned
+ * @see     k_free_k_stack
+ */
+U32* k_alloc_k_stack(task_t tid)
+{
+    
+    if ( tid >= MAX_TASKS || g_tcbs[tid] == NULL) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    TCB *p_tcb = g_tcbs[tid];
+    SLAB *page = g_kstack_pages;
+    
+    if (page == NULL) {
+        U8 *blk = k_mpool_alloc(MPID_IRAM2, KSTACK_PAGE_SIZE);
+        if (blk == NULL) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        page = k_kstack_page_of(blk);
+        page->obj_size = KERN_STACK_SIZE;
+        page->nfree = KSTACK_PER_PAGE;
+        page->free = NULL;
+        // thread from the last stack so the free list starts at the lowest one
+        for (int i = KSTACK_PER_PAGE - 1; i >= 0; i--) {
+            void **stack = (void **)(blk + i * KERN_STACK_SIZE);
+            *stack = page->free;
+            page->free = stack;
+        }
+        page->next = NULL;
+        g_kstack_pages = page;
+    }
+    
+    U32 *stack = page->free;
+    page->free = *(void **)stack;
+    if (--page->nfree == 0) {
+        g_kstack_pages = page->next;    // full pages are not tracked
+    }
+    p_tcb->k_stack_size = KERN_STACK_SIZE;
+    p_tcb->k_sp_base = (U32)stack + KERN_STACK_SIZE;
+    // KERN_STACK_SIZE is a multiple of 8, so the top is 8B aligned
+    return (U32 *)p_tcb->k_sp_base;
+}
+
+/**
+ * @brief   give the kernel stack of a task back to its page, an empty page
+ *          goes back to MPID_IRAM2 unless it is the only one with free stacks
+ * @pre     the task is not running on it any more
+ */
+void k_free_k_stack(task_t tid)
+{
+    TCB *p_tcb = g_tcbs[tid];
+    
+    if (p_tcb == NULL || p_tcb->k_sp_base == 0) {
+        return;
+    }
+    void **stack = (void **)(p_tcb->k_sp_base - p_tcb->k_stack_size);
+    SLAB *page = k_kstack_page_of(stack);
+    
+    *stack = page->free;
+    page->free = stack;
+    if (page->nfree++ == 0) {
+        page->next = g_kstack_pages;
+        g_kstack_pages = page;
+    }
+    if (page->nfree == KSTACK_PER_PAGE && (g_kstack_pages != page || page->next != NULL)) {
+        SLAB **pp = &g_kstack_pages;
+        while (*pp != page) {
+            pp = &(*pp)->next;
+        }
+        *pp = page->next;
+        k_mpool_free(MPID_IRAM2, (void *)((U32)stack & ~(KSTACK_PAGE_SIZE - 1)), TRUE);
+    }
+    p_tcb->k_sp_base = 0;
+    p_tcb->k_stack_size = 0;
+}
+
+/**
+ * @brief allocate user/process stack statically
+ * @attention  you should not use this function in your lab
+ */
+
+U32* k_alloc_p_stack(task_t tid)
+{
+    if ( tid >= NUM_TASKS ) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    
+    U32 *sp = g_p_stacks[tid+1];
+    
+    
+    // 8B stack alignment adjustment
+    if ((U32)sp & 0x04) {   // if sp not 8B aligned, then it must be 4B aligned
+        sp--;               // adjust it to 8B aligned
+    }
+    return sp;
+}
+
+/**
+ * @brief   allocate exactly size bytes as a run of buddy blocks
+ * @param   size    a multiple of MIN_BLK_SIZE
+ * @return  low address of the run, NULL on failure
+ * @note    the power of two block holding the run is split down its right
+ *          edge and the buddies past the end go back to the free lists, so
+ *          the run is one allocated block per bit set in size, the biggest
+ *          first, which is how k_mpool_free_run gives it back
+ */
+static void *k_mpool_alloc_run(mpool_t mpid, size_t size)
+{
+    MPOOL *pool = &g_mpools[mpid];
+    unsigned int pos;
+    U8 *blk = k_mpool_alloc(mpid, size);
+    
+    if (blk == NULL) {
+        return NULL;
+    }
+    
+    int k = k_mpool_blk_level(pool, blk, &pos);
+    U32 blk_size = computer_pwr2(pool->size_log2 - k);
+    U8 *p = blk;
+    U32 left = size;
+    
+    while (left < blk_size) {
+        U32 half = blk_size >> 1;
+        
+        pool->tree[pos] = 1;            // split, its children tell the rest
+        if (left <= half) {
+            // the right half is past the end of the run
+            DNODE *node = (DNODE *)(p + half);
+            DLIST *list = &pool->list[k + 1];
+            
+            node->treepos = 2 * pos + 2;
+            node->prev = NULL;
+            node->next = list->head;
+            if (list->head != NULL) {
+                list->head->prev = node;
+            }
+            list->head = node;
+            pool->tree[2 * pos + 2] = 0;
+            pool->free_bytes += half;
+            pos = 2 * pos + 1;
+        } else {
+            // the left half is a whole block of the run
+            pool->tree[2 * pos + 1] = 1;
+            pos = 2 * pos + 2;
+            p += half;
+            left -= half;
+        }
+        k++;
+        blk_size = half;
+    }
+    pool->tree[pos] = 1;
+    return blk;
+}
+
+/**
+ * @brief   give back a run from k_mpool_alloc_run, block by block
+ */
+static void k_mpool_free_run(mpool_t mpid, void *ptr, size_t size)
+{
+    U8 *p = ptr;
+    
+    for (U32 bit = computer_pwr2(find_log(size)); bit >= MIN_BLK_SIZE; bit >>= 1) {
+        if (size & bit) {
+            k_mpool_dealloc(mpid, p);
+            p += bit;
+        }
+    }
+}
+
+/**
+ * @brief   g_stack_pools class of a stack size
+ * @return  the class, -1 if size is not exactly one of the pooled sizes
+ */
+static int k_stack_pool_class(U32 size)
+{
+    int log2 = find_log(size);
+    int cls = log2 - STACK_POOL_MIN_LOG2;
+    
+    if (cls < 0 || cls >= STACK_POOL_CLASSES || computer_pwr2(log2) != size) {
+        return -1;
+    }
+    return cls;
+}
+
+/**
+ * @brief   user stack of *size bytes from MPID_IRAM2
+ * @param   size    in: bytes asked for, out: bytes of the stack handed out,
+ *                  at least PROC_STACK_SIZE and rounded up to MIN_BLK_SIZE,
+ *                  never to a power of two
+ * @return  low address of the stack, NULL on failure
+ * @note    pooled sizes pop the stack of an exited task when there is one,
+ *          the others are carved exactly by k_mpool_alloc_run
+ */
+U32 *k_stack_alloc(U32 *size)
+{
+    if (*size > RAM2_SIZE) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    U32 bytes = (*size < PROC_STACK_SIZE) ? PROC_STACK_SIZE :
+                (*size + MIN_BLK_SIZE - 1) & ~(MIN_BLK_SIZE - 1);
+    int cls = k_stack_pool_class(bytes);
+    U32 *stack;
+    
+    if (cls >= 0 && g_stack_pools[cls].head != NULL) {
+        LAZYLIST *sp = &g_stack_pools[cls];
+        stack = (U32 *)sp->head;
+        sp->head = sp->head->next;
+        sp->count--;
+    } else {
+        stack = k_mpool_alloc_run(MPID_IRAM2, bytes);
+        if (stack == NULL) {
+            return NULL;
+        }
+    }
+    *size = bytes;
+    return stack;
+}
+
+/**
+ * @brief   give back a stack from k_stack_alloc, pooled sizes are kept
+ *          for the next task up to STACK_POOL_DEPTH
+ */
+void k_stack_free(U32 *stack, U32 size)
+{
+    int cls = k_stack_pool_class(size);
+    
+    if (cls >= 0 && g_stack_pools[cls].count < STACK_POOL_DEPTH) {
+        DNODE *node = (DNODE *)stack;     // the link sits at the stack limit
+        node->next = g_stack_pools[cls].head;
+        g_stack_pools[cls].head = node;
+        g_stack_pools[cls].count++;
+        return;
+    }
+    k_mpool_free_run(MPID_IRAM2, stack, size);
+}
+
+/**
+ * @brief   zero size bytes, size is a multiple of 16 and ptr is word aligned
+ */
+__asm void k_mem_zero16(void *ptr, U32 size)
+{
+        PRESERVE8
+        PUSH    {R4-R5}
+        MOV     R2, #0
+        MOV     R3, #0
+        MOV     R4, #0
+        MOV     R5, #0
+        B       K_ZERO16_TEST
+K_ZERO16_LOOP
+        STM     R0!, {R2-R5}                // four words per store
+K_ZERO16_TEST
+        SUBS    R1, R1, #16
+        BHS     K_ZERO16_LOOP
+        POP     {R4-R5}
+        BX      LR
+}
+
+/**
+ * @brief   zero size bytes at ptr, the aligned middle goes through STM
+ */
+void k_mem_zero(void *ptr, U32 size)
+{
+    U8 *p = ptr;
+    
+    while (((U32)p & 0x3) && size > 0) {
+        *p++ = 0;
+        size--;
+    }
+    k_mem_zero16(p, size & ~0xF);
+    p += size & ~0xF;
+    size &= 0xF;
+    while (size > 0) {
+        *p++ = 0;
+        size--;
+    }
+}
 
 unsigned int find_log(size_t size)
 {
@@ -28,6 +28,96 @@
 #include "k_inc.h"
 #include "lpc1768_mem.h"        // board memory map
 
+/*
+ * ------------------------------------------------------------------------
+ *                             MACROS
+ * ------------------------------------------------------------------------
+ */
+#define MAX_LEVELS          (IRAM2_SIZE_LOG2 - MIN_BLK_SIZE_LOG2 + 1)
+                                    /* max number of buddy levels of a pool */
+
+#ifndef LAZY_WATERMARK
+#define LAZY_WATERMARK      4       /* max uncoalesced free blocks per order, 0 disables lazy buddy */
+#endif
+
+#define LAZY_IDLE_BUDGET    2       /* deferred blocks coalesced per idle call */
+
+#define SLAB_PAGE_SIZE      0x200   /* buddy block carved into small objects */
+#define SLAB_PAGE_SIZE_LOG2 9       /* log2(SLAB_PAGE_SIZE) */
+#define SLAB_PAGE_LOG2_RAM1 7       /* MPID_IRAM1 slab pages are 0x80, 1/32 of the user heap */
+#define SLAB_MAX_SIZE_RAM1  16      /* larger MPID_IRAM1 requests gain nothing over
+                                       the MIN_BLK_SIZE buddy block */
+#define SLAB_HDR_SIZE       16      /* slab page header, keeps objects 8B aligned */
+#define SLAB_MIN_SIZE_LOG2  3       /* smallest size class is 8 bytes */
+#define SLAB_MAX_SIZE       128     /* largest size class in bytes */
+#define SLAB_NUM_CLASSES    5       /* 8, 16, 32, 64 and 128 bytes */
+#define MAG_SIZE            4       /* objects cached per task per size class */
+
+#define MAX_PRIV_HEAPS      4       /* max number of task private heaps */
+#define NUM_MPOOLS          (MAX_MPOOLS + MAX_PRIV_HEAPS)
+#define MPID_NONE           (-1)    /* no memory pool */
+#define PRIV_HEAP_MPID      MPID_IRAM2  /* pool private heaps are carved from */
+#define PRIV_HEAP_MIN_SIZE  (SLAB_PAGE_SIZE << 1)
+                                    /* min private heap size in bytes */
+
+#ifndef MEM_RESERVE_SIZE
+#define MEM_RESERVE_SIZE    0       /* MPID_IRAM1 free bytes kept for MEM_RESERVE_PRIO and
+                                       above, off by default, e.g. define it 0x400 to hold
+                                       back a quarter of the user heap */
+#endif
+#define MEM_RESERVE_PRIO    HIGH    /* lowest priority allowed into the reserve */
+
+#define MEM_WMARK_LOW       (RAM1_SIZE >> 1)    /* MPID_IRAM1 free bytes below which
+                                                   pressure is MEM_PRESSURE_LOW */
+#define MEM_WMARK_HIGH      (RAM1_SIZE >> 2)    /* and below which it is MEM_PRESSURE_HIGH */
+
+#define KSTACK_PAGE_SIZE    0x1000  /* MPID_IRAM2 block carved into kernel stacks */
+#define KSTACK_PER_PAGE     ((KSTACK_PAGE_SIZE - SLAB_HDR_SIZE) / KERN_STACK_SIZE)
+                                    /* 5 stacks of 0x300, the page header sits above them */
+
+#define STACK_POOL_MIN_LOG2 9       /* smallest pooled user stack, PROC_STACK_SIZE */
+#define STACK_POOL_CLASSES  3       /* 0x200, 0x400 and 0x800 byte stacks */
+#define STACK_POOL_DEPTH    2       /* exited task stacks kept per class */
+
+#define MEM_DMA_LIMIT       0x2000  /* MPID_IRAM2 bytes tasks may hold through MEM_DMA,
+                                       the rest stays for stacks and kernel objects */
+
+#define MAX_MHANDLES        32      /* max number of movable block handles */
+#define MHANDLE_MAX_LOCKS   0xFF    /* max nesting of mem_lock on one handle */
+#define COMPACT_IDLE_BUDGET 1       /* max blocks moved per null task pass */
+
+#define ZERO_CACHE_MAX_SIZE 0x200   /* largest MPID_IRAM1 block kept pre-zeroed */
+#define ZERO_CACHE_DEPTH    1       /* pre-zeroed blocks kept per order */
+#define ZERO_IDLE_BUDGET    1       /* max blocks zeroed per null task pass */
+#define ZERO_CACHE_HEADROOM MEM_WMARK_LOW   /* MPID_IRAM1 free bytes a parked block
+                                               must leave, the cache is flushed below it */
+
+#define HEAP_CHECK_BUDGET   8       /* max free list nodes or tree nodes
+                                       verified per null task pass */
+
+/* define DEBUG_HEAP to wrap mem_alloc blocks in canaries, poison them on
+   free and validate pointers given to the deallocators. The wrapper grows
+   every block, so leave it off when running the AE suite */
+#ifdef DEBUG_HEAP
+#define HEAP_CANARY         0xC0DECAFE  /* guard word of a live block */
+#define HEAP_CANARY_FREED   0xDEADF4EE  /* header guard once freed */
+#define HEAP_POISON         0xDD        /* fill byte of freed memory */
+#define HEAP_DBG_TRAILER    4           /* bytes of trailer canary */
+#define HEAP_DBG_OVERHEAD   (sizeof(HEAP_DBG_HDR) + HEAP_DBG_TRAILER)
+#endif /* DEBUG_HEAP */
+
+/* binary dump, tools/heap_view.py decodes it */
+#define HEAP_DUMP_MAGIC     0x4448  /* "HD" in little endian */
+#define HEAP_DUMP_VERSION   1
+#define HEAP_DUMP_CHUNK     16      /* bytes per UART chunk when streaming */
+#define HEAP_DUMP_FREE      0x80    /* run tag bit of free blocks, low bits hold the level */
+
+/* define MEM_PROFILE to account MPID_IRAM1 usage per mem_alloc call site,
+   tools/mem_prof.py symbolizes the mem_prof_dump output */
+#ifdef MEM_PROFILE
+#define PROF_SITES          32      /* call site table size, a power of two */
+#endif /* MEM_PROFILE */
+
 /*
  * ------------------------------------------------------------------------
  *                             FUNCTION PROTOTYPES
@@ -38,11 +128,56 @@ mpool_t k_mpool_create  (int algo, U32 strat, U32 end);
 void   *k_mpool_alloc   (mpool_t mpid, size_t size);
 int     k_mpool_dealloc (mpool_t mpid, void *ptr);
 int     k_mpool_dump    (mpool_t mpid);
+int     k_mpool_dump_bin(mpool_t mpid, U8 *buf, U32 size);
+
+int     k_mpool_destroy (mpool_t mpid);
+mpool_t k_mpool_find    (void *ptr);
 
 int     k_mem_init      (int algo);
 U32    *k_alloc_k_stack (task_t tid);
+void    k_free_k_stack  (task_t tid);
 U32    *k_alloc_p_stack (task_t tid);
+U32    *k_stack_alloc   (U32 *size);
+void    k_stack_free    (U32 *stack, U32 size);
 // declare newly added functions here
+int     k_mpool_free        (mpool_t mpid, void *ptr, BOOL lazy_ok);
+int     k_mpool_lazy_flush  (mpool_t mpid, int budget);
+int     k_mem_idle          (void);
+int     k_mpool_reclaim     (mpool_t mpid);
+
+void   *k_mem_alloc         (size_t size);
+void   *k_mem_alloc_flags   (size_t size, U32 flags);
+int     k_mem_dealloc       (void *ptr);
+mpool_t k_heap_create       (size_t size);
+int     k_heap_destroy      (mpool_t mpid);
+int     k_mem_set_quota     (task_t tid, U32 quota);
+int     k_mem_pressure      (void);
+int     k_mem_pressure_wait (U8 level);
+
+mhandle_t k_mem_halloc      (size_t size);
+int     k_mem_hfree         (mhandle_t handle);
+void    k_mem_hfree_task    (task_t tag);
+void   *k_mem_lock          (mhandle_t handle);
+int     k_mem_unlock        (mhandle_t handle);
+int     k_mem_compact       (int budget);
+
+void   *k_mem_calloc        (size_t num, size_t size);
+int     k_mem_zcache_fill   (int budget);
+void    k_mem_zero          (void *ptr, U32 size);
+void    k_mem_zero16        (void *ptr, U32 size);
+
+int     k_mem_check         (int budget);
+int     k_mem_snapshot      (MEM_SNAPSHOT *snap);
+int     k_mem_snapshot_diff (MEM_SNAPSHOT *snap);
+#ifdef MEM_PROFILE
+int     k_mem_prof_dump     (void);
+#endif /* MEM_PROFILE */
+
+void   *k_slab_alloc        (mpool_t mpid, size_t size);
+int     k_slab_free         (mpool_t mpid, void *ptr);
+BOOL    k_slab_owns         (mpool_t mpid, void *ptr);
+int     k_slab_reclaim      (mpool_t mpid);
+void    k_slab_flush_task   (task_t tid);
 
 
 unsigned int find_log(size_t size);
@@ -62,6 +197,105 @@ typedef struct linkedlist
     DNODE *tail;
 }DLIST;
 
+/* free blocks of one order whose buddy merge is deferred,
+   they stay marked as allocated in the buddy tree */
+typedef struct lazylist
+{
+    DNODE *head;
+    int count;
+}LAZYLIST;
+
+/* header at the start of a slab page, objects of one size class follow it */
+typedef struct slab
+{
+    struct slab *next;  /* next page of the class with free objects */
+    void *free;         /* free objects inside this page */
+    U16 obj_size;
+    U16 nfree;
+}SLAB;
+
+/* per size class list of slab pages that still have free objects */
+typedef struct slab_cache
+{
+    SLAB *partial;
+}SLAB_CACHE;
+
+/* buddy memory pool descriptor */
+typedef struct mpool
+{
+    U32 start;          /* start address, aligned to the pool size */
+    U32 end;            /* end address */
+    int size_log2;      /* log2 of the pool size */
+    int num_levels;     /* number of buddy levels, level 0 is the whole pool */
+    DLIST *list;        /* list[n] holds the free blocks of level n */
+    U8 *tree;           /* one byte per buddy tree node, 1 = split or used */
+    LAZYLIST *lazy;     /* deferred free blocks per level */
+    U8 *slab_pages;     /* non-zero entry marks a slab page */
+    int slab_log2;      /* log2 of the slab page size */
+    U32 slab_max;       /* largest request served by the slab layer */
+    U32 free_bytes;     /* bytes in free and deferred buddy blocks */
+    void *meta;         /* metadata block of a private heap, from MPID_IRAM2 */
+    BOOL active;
+}MPOOL;
+
+/* per task stack of free objects of one size class, MPID_IRAM1 only */
+typedef struct magazine
+{
+    void *rounds[MAG_SIZE];
+    int count;
+}MAGAZINE;
+
+/* movable MPID_IRAM1 block, the compactor may move it while unlocked */
+typedef struct mhandle
+{
+    void *ptr;          /* current block address, NULL if the slot is free */
+    U8 locks;           /* mem_lock nesting, the block is pinned while non-zero */
+    U8 owner;           /* k_tsk_tag of the task that allocated it */
+}MHANDLE;
+
+/* output of the binary heap dump, a caller buffer or a chunk that is
+   streamed to the UART in hex whenever it fills up */
+typedef struct heap_dump_out
+{
+    U8 *buf;
+    U32 size;
+    U32 len;            /* bytes in buf */
+    U32 total;          /* bytes produced so far */
+    BOOL stream;
+}HEAP_DUMP_OUT;
+
+/* DEBUG_HEAP header in front of every mem_alloc block, 16 bytes keep the
+   user pointer 8B aligned. The canary sits past the first 12 bytes, which
+   buddy and slab free list links overwrite */
+typedef struct heap_dbg_hdr
+{
+    U32 size;           /* bytes requested */
+    U32 pc;             /* caller PC of the allocation */
+    U8 tid;             /* allocating task */
+    U8 pad[3];
+    U32 canary;         /* HEAP_CANARY, HEAP_CANARY_FREED once freed */
+}HEAP_DBG_HDR;
+
+/* MEM_PROFILE bytes charged to one call site, pc 0 marks a free slot */
+typedef struct mem_site
+{
+    U32 pc;             /* return address of the allocating SVC */
+    U32 count;          /* allocations made */
+    U32 live;           /* bytes currently held */
+    U32 peak;           /* max of live */
+}MEM_SITE;
+
+/* position of the incremental heap checker, it verifies the free lists of
+   a pool level by level and then its buddy tree before moving on */
+typedef struct heap_check
+{
+    mpool_t mpid;       /* pool being checked */
+    BOOL tree;          /* FALSE while on the free lists, TRUE on the tree */
+    int level;          /* free list being checked */
+    int index;          /* next list position or tree node to check */
+    U32 errors;         /* inconsistencies reported so far */
+}HEAP_CHECK;
+
 
 /*
  * ------------------------------------------------------------------------
@@ -80,6 +80,24 @@ int k_get_sys_info(RTX_SYS_INFO *buffer)
     return RTX_OK;
 }
 
+/**************************************************************************//**
+ * @brief       bounded kernel housekeeping, called by the null task only
+ * @return      RTX_OK on success and RTX_ERR on failure
+ *****************************************************************************/
+int k_rtx_idle(void)
+{
+    if (gp_current_task->tid != TID_NULL) {
+        errno = EPERM;
+        return RTX_ERR;
+    }
+    
+    k_mem_idle();
+#ifdef STACK_CHECK
+    k_tsk_stack_check();
+#endif /* STACK_CHECK */
+    return RTX_OK;
+}
+
 /*
  *===========================================================================
  *                             END OF FILE
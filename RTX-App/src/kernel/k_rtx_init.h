@@ -52,6 +52,7 @@
 int  k_pre_pre_init (void *args);
 int  k_rtx_init(RTX_SYS_INFO *sys_info, TASK_INIT *task, int num_tasks);
 int  k_get_sys_info(RTX_SYS_INFO *buffer);
+int  k_rtx_idle(void);
 
 #endif /* ! K_RTX_INIT_H_ */
 
@@ -36,7 +36,8 @@
  * @attention   assumes NO HARDWARE INTERRUPTS
  * @details     The starter code shows one way of implementing context switching.
  *              The code only has minimal sanity check.
- *              There is no stack overflow check.
+ *              Stack overflow checks are optional, see STACK_CHECK and
+ *              STACK_GUARD.
  *              The implementation assumes only three simple tasks and
  *              NO HARDWARE INTERRUPTS.
  *              The purpose is to show how context switch could be done
@@ -59,9 +60,24 @@
  */
 
 TCB             *gp_current_task = NULL;    // the current RUNNING task
-TCB             g_tcbs[MAX_TASKS];          // an array of TCBs
+TCB            *g_tcbs[MAX_TASKS];          // TCB of each tid, NULL if unused
 //TASK_INIT       g_null_task_info;           // The null task info
 U32             g_num_active_tasks = 0;     // number of non-dormant tasks
+U32             g_svc_caller_pc = 0;        // stacked PC of the SVC being served
+U32             g_tid_free[TID_WORDS];      // TID_BIT of every unused task id
+U8              g_tid_gen[MAX_TASKS];       // generation of each tid slot, see TID_SLOT_BITS
+TCB            *gp_exited_task = NULL;      // exited task whose TCB is not freed yet
+U32             g_cpu_stamp = 0;            // DWT->CYCCNT when the last cycles were charged
+U64             g_cpu_isr = 0;              // cycles spent in k_isr_enter/k_isr_exit brackets
+U64             g_cpu_exited = 0;           // cycles of the tasks that have exited
+static U32      g_isr_nest = 0;             // interrupt nesting depth
+static U32      g_isr_stamp = 0;            // DWT->CYCCNT at the outermost k_isr_enter
+SCHED_HIST      g_sched_hist;               // ready queue wait and length histograms
+#ifdef SWITCH_PROFILE
+SWITCH_STAT     g_switch_stats[SWITCH_KINDS];   // k_tsk_switch timing per privilege pair
+static U32      g_switch_stamp = 0;         // DWT->CYCCNT just before the last k_tsk_switch
+static U32      g_switch_kind  = 0;         // g_switch_stats index of the last k_tsk_switch
+#endif /* SWITCH_PROFILE */
 
 Queue array_of_queue[PRIORITY_NUM];
 /*---------------------------------------------------------------------------
@@ -86,22 +102,8 @@ The memory map of the OS image may look like the following:
                               |      PROC_STACK_SIZE      |     |
               g_p_stacks[0]-->|---------------------------|     |
                               |   other  global vars      |     |
-                              |                           |  OS Image
                               |---------------------------|     |
-                              |      KERN_STACK_SIZE      |     |                
-             g_k_stacks[15]-->|---------------------------|     |
-                              |                           |     |
-                              |     other kernel stacks   |     |                              
-                              |---------------------------|     |
-                              |      KERN_STACK_SIZE      |  OS Image
-              g_k_stacks[2]-->|---------------------------|     |
-                              |      KERN_STACK_SIZE      |     |                      
-              g_k_stacks[1]-->|---------------------------|     |
-                              |      KERN_STACK_SIZE      |     |
-              g_k_stacks[0]-->|---------------------------|     |
-                              |   other  global vars      |     |
-                              |---------------------------|     |
-                              |        TCBs               |  OS Image
+                              |     TCB pointers          |  OS Image
                       g_tcbs->|---------------------------|     |
                               |        global vars        |     |
                               |---------------------------|     |
@@ -119,13 +121,280 @@ The memory map of the OS image may look like the following:
  *===========================================================================
  */
 
+/**
+ * @brief   charge the cycles since the last charge to a task bucket
+ * @note    on the SVC entry, SVC exit and task switch paths, keep it short
+ */
+static __inline void k_cpu_charge(U64 *bucket)
+{
+    U32 now = DWT->CYCCNT;
+    
+    *bucket += now - g_cpu_stamp;   // U32 difference, correct across a wrap
+    g_cpu_stamp = now;
+}
+
+#ifdef SWITCH_PROFILE
+/**
+ * @brief   account one k_tsk_switch that took cycles
+ */
+static void k_switch_prof_end(U32 cycles)
+{
+    SWITCH_STAT *stat = &g_switch_stats[g_switch_kind];
+    
+    if (stat->count == 0 || cycles < stat->min) {
+        stat->min = cycles;
+    }
+    if (cycles > stat->max) {
+        stat->max = cycles;
+    }
+    stat->total += cycles;
+    stat->count++;
+}
+#endif /* SWITCH_PROFILE */
+
+/**
+ * @brief   fill a stack with STACK_PAINT
+ * @param   lo      lowest word of the stack
+ * @param   size    stack size in bytes, a multiple of 4
+ */
+static void k_stack_paint(U32 *lo, U32 size)
+{
+    U32 *end = (U32 *)((U32)lo + size);
+    
+    while (lo < end) {
+        *lo++ = STACK_PAINT;
+    }
+}
+
+/**
+ * @brief   peak usage of a painted stack in bytes
+ * @param   base    stack base, the high address
+ * @param   size    stack size in bytes
+ * @note    stacks grow down, so the scan starts at the low end and stops
+ *          at the first word ever written
+ */
+static U32 k_stack_hwm(U32 base, U32 size)
+{
+    U32 *lo  = (U32 *)(base - size);
+    U32 *end = (U32 *)base;
+    
+    while (lo < end && *lo == STACK_PAINT) {
+        lo++;
+    }
+    return (U32)end - (U32)lo;
+}
+
+/**
+ * @brief   claim the lowest free task id and a TCB for it from MPID_IRAM2
+ * @return  the zeroed DORMANT TCB with its tid set, NULL on failure
+ */
+static TCB *k_tsk_tcb_alloc(void)
+{
+    int w = 0;
+    
+    while (w < TID_WORDS && g_tid_free[w] == 0) {
+        w++;
+    }
+    if (w == TID_WORDS) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    
+    TCB *p_tcb = k_mpool_alloc(MPID_IRAM2, sizeof(TCB));
+    if (p_tcb == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    k_mem_zero(p_tcb, sizeof(TCB));
+    p_tcb->tid   = (w << 5) + __clz(g_tid_free[w]);  // lowest free task id
+    p_tcb->state = DORMANT;
+    g_tid_free[w] &= ~TID_BIT(p_tcb->tid);
+    g_tcbs[p_tcb->tid] = p_tcb;
+    return p_tcb;
+}
+
+/**
+ * @brief   give a TCB back to MPID_IRAM2 and its tid to g_tid_free
+ * @note    the slot moves to its next generation, which retires the tid
+ */
+static void k_tsk_tcb_free(TCB *p_tcb)
+{
+    g_tcbs[p_tcb->tid] = NULL;
+    g_tid_gen[p_tcb->tid] = (g_tid_gen[p_tcb->tid] + 1) % TID_GENS;
+    g_tid_free[TID_WORD(p_tcb->tid)] |= TID_BIT(p_tcb->tid);
+    k_mpool_dealloc(MPID_IRAM2, p_tcb);
+}
+
+/**
+ * @brief   free the TCB and kernel stack of the last task that exited
+ * @note    an exiting task runs on its kernel stack until k_tsk_switch has
+ *          saved its SP into its TCB, so the next SVC frees them
+ */
+static void k_tsk_reap(void)
+{
+    TCB *p_tcb = gp_exited_task;
+    
+    if (p_tcb == NULL || p_tcb == gp_current_task) {
+        return;
+    }
+    gp_exited_task = NULL;
+    k_free_k_stack(p_tcb->tid);
+    k_tsk_tcb_free(p_tcb);
+}
+
+/**
+ * @brief   owner tag of a task, its tid with the slot generation above it
+ * @note    TID_KERN, TID_UNK and the like are returned as they are
+ */
+task_t k_tsk_tag(task_t slot)
+{
+    if (slot >= MAX_TASKS) {
+        return slot;
+    }
+    return (g_tid_gen[slot] << TID_SLOT_BITS) | slot;
+}
+
+/**
+ * @brief   TCB named by an owner tag
+ * @return  the TCB, NULL if the slot is out of range, unused, or has been
+ *          reused since the tag was taken
+ */
+TCB *k_tsk_lookup(task_t tag)
+{
+    task_t slot = tag & TID_SLOT_MASK;
+    
+    if (slot >= MAX_TASKS || (tag >> TID_SLOT_BITS) != g_tid_gen[slot]) {
+        return NULL;
+    }
+    return g_tcbs[slot];
+}
+
+/**
+ * @brief   lowest live task id at or above tid
+ * @return  the task id, MAX_TASKS if there is none
+ * @note    a tid is live when it is allocated and its task has not exited
+ */
+static int k_tsk_next_live(int tid)
+{
+    while (tid < MAX_TASKS) {
+        U32 used = ~g_tid_free[TID_WORD(tid)] & (0xFFFFFFFFU >> (tid & 0x1F));
+        
+        if (used == 0) {
+            tid = (tid | 0x1F) + 1;     // rest of the word is free
+            continue;
+        }
+        tid = (tid & ~0x1F) + __clz(used);
+        if (tid < MAX_TASKS && g_tcbs[tid]->state != DORMANT) {
+            return tid;
+        }
+        tid++;
+    }
+    return MAX_TASKS;
+}
+
+/**
+ * @brief   stamp a task put on ready queue q and count the new queue length
+ */
+static __inline void k_sched_enqueued(Queue *q, task_t tid)
+{
+    U32 level = q - array_of_queue;
+    U32 bucket = 31 - __clz(q->size);
+    
+    g_tcbs[tid]->ready_stamp = DWT->CYCCNT;
+    if (bucket >= SCHED_QLEN_BUCKETS) {
+        bucket = SCHED_QLEN_BUCKETS - 1;    // the last bucket takes all longer queues
+    }
+    if (level < SCHED_HIST_LEVELS) {
+        g_sched_hist.qlen[level][bucket]++;
+    }
+}
+
+/**
+ * @brief   count how long a task dispatched from ready queue q waited
+ */
+static __inline void k_sched_dispatched(Queue *q, task_t tid)
+{
+    U32 level = q - array_of_queue;
+    U32 wait  = DWT->CYCCNT - g_tcbs[tid]->ready_stamp;
+    
+    if (level < SCHED_HIST_LEVELS) {
+        g_sched_hist.wait[level][31 - __clz(wait | 1)]++;
+    }
+}
+
+#ifdef K_SHARED_STACK
+/**************************************************************************//**
+ * @brief   	SVC Handler, single kernel stack
+ * @pre         PSP is used in thread mode before entering SVC Handler
+ *              SVC_Handler is configured as the highest interrupt priority
+ * @details     k_svc_dispatch serves the call. If it changed gp_current_task
+ *              the old task's R4-R11 go onto its user stack, below the
+ *              exception frame, and the new task's are popped from its own.
+ *              The MSP unwinds fully on every return.
+ *****************************************************************************/
+__asm void SVC_Handler(void)
+{
+        PRESERVE8
+        IMPORT  k_svc_dispatch
+        
+        LDR     R0, =__cpp(&gp_current_task)
+        LDR     R1, [R0]
+        PUSH    {R1, LR}                    // task being served, EXC_RETURN
+        BL      k_svc_dispatch
+        POP     {R1, LR}
+        LDR     R0, =__cpp(&gp_current_task)
+        LDR     R2, [R0]
+        CMP     R1, R2
+        BEQ     K_SVC_RET                   // same task, plain return
+        CBZ     R1, K_SVC_START             // first task, k_rtx_init is returning
+        LDRB    R0, [R1, #TCB_STATE_OFFSET]
+        CMP     R0, #DORMANT
+        BEQ     K_SVC_IN                    // exited, its user stack is gone
+        MRS     R3, PSP
+        STMDB   R3!, {R4-R11}               // save the old task below its exception frame
+        STR     R3, [R1, #TCB_U_SP_OFFSET]
+        B       K_SVC_IN
+K_SVC_START
+        LDR     R0, =__cpp(&g_k_stack[KERN_STACK_SIZE >> 2])
+        MSR     MSP, R0                     // leave the boot stack, nothing on it is needed
+K_SVC_IN
+        LDR     R3, [R2, #TCB_U_SP_OFFSET]
+        LDMIA   R3!, {R4-R11}               // restore the new task
+        MSR     PSP, R3
+        LDRB    R0, [R2, #TCB_PRIV_OFFSET]
+        MRS     R1, CONTROL
+        ORR     R1, R1, #1                  // unprivileged
+        CMP     R0, #0
+        IT      NE
+        BICNE   R1, R1, #1                  // privileged
+        MSR     CONTROL, R1
+        ISB
+        MVN     LR, #:NOT:0xFFFFFFFD        // thread mode, PSP
+K_SVC_RET
+        BX      LR
+        ALIGN
+}
+
+/**
+ * @brief   set the R0 a switched out task sees when it is switched back in
+ */
+void k_tsk_set_ret(TCB *p_tcb, U32 ret)
+{
+    ((U32 *)p_tcb->u_sp)[8] = ret;  // stacked R0 sits above the saved R4-R11
+}
+#endif /* K_SHARED_STACK */
+
 /**************************************************************************//**
  * @brief   	SVC Handler
  * @pre         PSP is used in thread mode before entering SVC Handler
  *              SVC_Handler is configured as the highest interrupt priority
  *****************************************************************************/
 
+#ifdef K_SHARED_STACK
+void k_svc_dispatch(void)
+#else
 void SVC_Handler(void)
+#endif /* K_SHARED_STACK */
 {
     
     U8   svc_number;
@@ -133,15 +402,20 @@ void SVC_Handler(void)
     U32 *args = (U32 *) __get_PSP();    // read PSP to get stacked args
     
     svc_number = ((S8 *) args[6])[-2];  // Memory[(Stacked PC) - 2]
+    g_svc_caller_pc = args[6];
+    if (gp_current_task != NULL) {
+        k_cpu_charge(&gp_current_task->cpu_user);
+    }
+    k_tsk_reap();
     switch(svc_number) {
         case SVC_RTX_INIT:
             ret = k_rtx_init((RTX_SYS_INFO*) args[0], (TASK_INIT *) args[1], (int) args[2]);
             break;
         case SVC_MEM_ALLOC:
-            ret = (U32) k_mpool_alloc(MPID_IRAM1, (size_t) args[0]);
+            ret = (U32) k_mem_alloc((size_t) args[0]);
             break;
         case SVC_MEM_DEALLOC:
-            ret = k_mpool_dealloc(MPID_IRAM1, (void *)args[0]);
+            ret = k_mem_dealloc((void *)args[0]);
             break;
         case SVC_MEM_DUMP:
             ret = k_mpool_dump(MPID_IRAM1);
@@ -164,11 +438,84 @@ void SVC_Handler(void)
         case SVC_TSK_GETTID:
             ret = k_tsk_gettid();
             break;
+        case SVC_RTX_IDLE:
+            ret = k_rtx_idle();
+            break;
+        case SVC_TSK_CREATE_EXT:
+            ret = k_tsk_create_ext((task_t *)(args[0]), (TASK_INIT_EXT *)(args[1]));
+            break;
+        case SVC_MEM_SET_QUOTA:
+            ret = k_mem_set_quota((task_t) args[0], (U32) args[1]);
+            break;
+        case SVC_MEM_HALLOC:
+            ret = k_mem_halloc((size_t) args[0]);
+            break;
+        case SVC_MEM_HFREE:
+            ret = k_mem_hfree((mhandle_t) args[0]);
+            break;
+        case SVC_MEM_LOCK:
+            ret = (U32) k_mem_lock((mhandle_t) args[0]);
+            break;
+        case SVC_MEM_UNLOCK:
+            ret = k_mem_unlock((mhandle_t) args[0]);
+            break;
+        case SVC_MEM_CALLOC:
+            ret = (U32) k_mem_calloc((size_t) args[0], (size_t) args[1]);
+            break;
+#ifdef MEM_PROFILE
+        case SVC_MEM_PROF_DUMP:
+            ret = k_mem_prof_dump();
+            break;
+#endif /* MEM_PROFILE */
+        case SVC_MEM_SNAPSHOT:
+            ret = k_mem_snapshot((MEM_SNAPSHOT *) args[0]);
+            break;
+        case SVC_MEM_SNAPSHOT_DIFF:
+            ret = k_mem_snapshot_diff((MEM_SNAPSHOT *) args[0]);
+            break;
+        case SVC_MEM_DUMP_BIN:
+            ret = k_mpool_dump_bin(MPID_IRAM1, (U8 *) args[0], (U32) args[1]);
+            break;
+        case SVC_MEM_PRESSURE:
+            ret = k_mem_pressure();
+            break;
+        case SVC_MEM_PRESSURE_WAIT:
+            ret = k_mem_pressure_wait((U8) args[0]);
+            break;
+        case SVC_MEM_ALLOC_FLAGS:
+            ret = (U32) k_mem_alloc_flags((size_t) args[0], (U32) args[1]);
+            break;
+        case SVC_TSK_LS:
+            ret = k_tsk_ls((task_t *) args[0], (int) args[1]);
+            break;
+        case SVC_TSK_GET_ALL:
+            ret = k_tsk_get_all((RTX_TASK_INFO_EXT *) args[0], (int) args[1]);
+            break;
+        case SVC_TSK_GET_EXT:
+            ret = k_tsk_get_ext((task_t) args[0], (RTX_TASK_INFO_EXT *) args[1]);
+            break;
+        case SVC_TSK_TOP:
+            ret = k_tsk_top();
+            break;
+        case SVC_SCHED_HIST:
+            ret = k_sched_hist((SCHED_HIST *) args[0], (BOOL) args[1]);
+            break;
+#ifdef SWITCH_PROFILE
+        case SVC_TSK_SWITCH_PROF:
+            ret = k_tsk_switch_prof_dump();
+            break;
+        case SVC_TSK_SWITCH_STAT:
+            ret = k_tsk_switch_stat((SWITCH_STAT *) args[0], (BOOL) args[1]);
+            break;
+#endif /* SWITCH_PROFILE */
         default:
             ret = (U32) RTX_ERR;
     }
     
     args[0] = ret;      // return value saved onto the stacked R0
+    if (gp_current_task != NULL) {
+        k_cpu_charge(&gp_current_task->cpu_kernel);
+    }
 }
 
 /**************************************************************************//**
@@ -183,12 +530,14 @@ void SVC_Handler(void)
 TCB *scheduler(void)
 {
     U8 next_tid = gp_current_task->tid;
-    U8 current_highest_prio = current_priority_level();
-    if(current_highest_prio == PRIO_NULL){
-        return &g_tcbs[TID_NULL];
+    int current_highest_prio = current_priority_level();   // queue index, -1 if all empty
+    if(current_highest_prio < 0){
+        return g_tcbs[TID_NULL];
     }
-    next_tid = pop(&(array_of_queue[current_highest_prio-0x80]));
-    return &g_tcbs[next_tid];
+    Queue *q = &(array_of_queue[current_highest_prio]);
+    next_tid = pop(q);
+    k_sched_dispatched(q, next_tid);
+    return g_tcbs[next_tid];
 
 }
 
@@ -224,15 +573,25 @@ int k_tsk_init(TASK_INIT *task, int num_tasks)
     }
     
     TASK_INIT taskinfo;
-    for(int i=0; i< MAX_TASKS; i++){
-        g_tcbs[i].state = 4;
+    TCB *p_tcb;
+    
+    for (int w = 0; w < TID_WORDS; w++) {
+        g_tid_free[w] = 0;
     }
+    for (int i = 0; i < MAX_TASKS; i++) {
+        g_tcbs[i] = NULL;
+        g_tid_gen[i] = 0;
+        g_tid_free[TID_WORD(i)] |= TID_BIT(i);
+    }
+    gp_exited_task = NULL;
     queue_init();
+    k_cpu_init();
     k_tsk_init_first(&taskinfo);
 
-    if ( k_tsk_create_new(&taskinfo, &g_tcbs[TID_NULL], TID_NULL) == RTX_OK ) {
+    p_tcb = k_tsk_tcb_alloc();          // all tids are free, so TID_NULL
+    if ( p_tcb != NULL && k_tsk_create_new(&taskinfo, p_tcb, TID_NULL, 0) == RTX_OK ) {
         g_num_active_tasks = 1;
-        gp_current_task = &g_tcbs[TID_NULL];
+        gp_current_task = p_tcb;
         push_back(&(array_of_queue[4]), gp_current_task->tid);
     } else {
         g_num_active_tasks = 0;
@@ -241,15 +600,23 @@ int k_tsk_init(TASK_INIT *task, int num_tasks)
     
     // create the rest of the tasks
     for ( int i = 0; i < num_tasks; i++ ) {
-        TCB *p_tcb = &g_tcbs[i+1];
-        if (k_tsk_create_new(&task[i], p_tcb, i+1) == RTX_OK) {
-            push_back(&(array_of_queue[task[i].prio-0x80]), p_tcb->tid);
+        p_tcb = k_tsk_tcb_alloc();
+        if (p_tcb == NULL) {
+            break;
+        }
+        if (k_tsk_create_new(&task[i], p_tcb, p_tcb->tid, 0) == RTX_OK) {
+            push_back(&(array_of_queue[PRIO_QUEUE(task[i].prio)]), p_tcb->tid);
             g_num_active_tasks++;
-            //push_back(&(array_of_queue[task[i].prio-0x80]), p_tcb->tid);
+        } else {
+            k_tsk_tcb_free(p_tcb);
         }
     }
     gp_current_task = scheduler();
     gp_current_task->state = RUNNING;
+#ifdef STACK_GUARD
+    k_mpu_init();
+    k_stack_guard(gp_current_task);
+#endif /* STACK_GUARD */
     return RTX_OK;
 }
 /**************************************************************************//**
@@ -260,16 +627,17 @@ int k_tsk_init(TASK_INIT *task, int num_tasks)
  * @param       p_taskinfo  task initialization structure pointer
  * @param       p_tcb       the tcb the task is assigned to
  * @param       tid         the tid the task is assigned to
+ * @param       u_heap_size private heap size in bytes, 0 for none
  *
  * @details     From bottom of the stack,
  *              we have user initial context (xPSR, PC, SP_USR, uR0-uR3)
- *              then we stack up the kernel initial context (kLR, kR4-kR12, PSP, CONTROL)
+ *              then we stack up the kernel initial context (kLR, kR4-kR11, PSP)
  *              The PC is the entry point of the user task
  *              The kLR is set to SVC_RESTORE
- *              20 registers in total
+ *              18 registers in total
  * @note        YOU NEED TO MODIFY THIS FILE!!!
  *****************************************************************************/
-int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
+int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid, U32 u_heap_size)
 {
     extern U32 SVC_RTE;
 
@@ -282,7 +650,7 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
     }
 
     p_tcb->tid   = tid;
-    p_tcb->state = READY;
+    p_tcb->state = DORMANT;             // READY once everything is allocated
     p_tcb->prio  = p_taskinfo->prio;
     p_tcb->priv  = p_taskinfo->priv;
     
@@ -295,30 +663,36 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
      * -------------------------------------------------------------*/
     
     //usp = k_alloc_p_stack(tid);             // ***you need to change this line***
-    int size_of_stack = PROC_STACK_SIZE;
-    if(PROC_STACK_SIZE >= p_taskinfo->u_stack_size){
-        usp = k_mpool_alloc(MPID_IRAM2, PROC_STACK_SIZE);
-        if(usp == NULL){
-            errno = ENOMEM;
-            return RTX_ERR;
-        }
-    }else{
-        usp = k_mpool_alloc(MPID_IRAM2, p_taskinfo->u_stack_size);
-        if(usp == NULL){
-            errno = ENOMEM;
-            return RTX_ERR;
-        }
-        while(size_of_stack < p_taskinfo->u_stack_size){
-            size_of_stack = size_of_stack << 1;
-        }
+    U32 size_of_stack = p_taskinfo->u_stack_size;
+    usp = k_stack_alloc(&size_of_stack);
+    if(usp == NULL){
+        errno = ENOMEM;
+        return RTX_ERR;
     }
+    k_stack_paint(usp, size_of_stack);
     usp = (U32*)((U32)usp + (U32)size_of_stack);
-    p_tcb->tid = tid;
-    p_tcb->state = READY;
-    p_tcb->prio = p_taskinfo->prio;
-    p_tcb->priv = p_taskinfo->priv;
+    p_tcb->ptask = p_taskinfo->ptask;
     p_tcb->u_stack_size = size_of_stack;
-    p_tcb->u_sp_base = usp;
+    p_tcb->u_sp_base = (U32)usp;
+    p_tcb->heap = MPID_NONE;
+    p_tcb->mem_quota = 0;
+    p_tcb->mem_used = 0;
+    p_tcb->mem_wait = MEM_PRESSURE_NONE;
+    p_tcb->cpu_user   = 0;
+    p_tcb->cpu_kernel = 0;
+    p_tcb->mags = NULL;
+#ifdef STACK_CHECK
+    p_tcb->stack_warned = FALSE;
+#endif /* STACK_CHECK */
+    
+    if (u_heap_size > 0) {
+        p_tcb->heap = k_heap_create(u_heap_size);
+        if (p_tcb->heap == RTX_ERR) {
+            p_tcb->heap = MPID_NONE;
+            k_stack_free((U32*)((U32)usp - size_of_stack), size_of_stack);
+            return RTX_ERR;             // errno set by k_heap_create
+        }
+    }
 
 
     /*-------------------------------------------------------------------
@@ -348,23 +722,41 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
         *(--usp) = 0x0;
 #endif
     }
-    p_tcb->usp = (U32)usp;
+#ifdef K_SHARED_STACK
+    // R4-R11, popped by SVC_Handler when the task is first switched in
+    for ( int j = 0; j < 8; j++ ) {
+        *(--usp) = 0x0;
+    }
+    p_tcb->u_sp = (U32)usp;
+#else
+    p_tcb->u_sp = (U32)usp;
     // allocate kernel stack for the task
     ksp = k_alloc_k_stack(tid);
     if ( ksp == NULL ) {
+        // unwind in k_tsk_exit order
+        if (p_tcb->heap != MPID_NONE) {
+            k_heap_destroy(p_tcb->heap);
+            p_tcb->heap = MPID_NONE;
+        }
+        k_stack_free((U32*)((U32)p_tcb->u_sp_base - p_tcb->u_stack_size), p_tcb->u_stack_size);
+        p_tcb->u_stack_size = 0;
+        p_tcb->u_sp_base = NULL;
+        errno = ENOMEM;
         return RTX_ERR;
     }
+    k_stack_paint((U32 *)(p_tcb->k_sp_base - p_tcb->k_stack_size), p_tcb->k_stack_size);
 
     /*---------------------------------------------------------------
      *  Step3: create task kernel initial context on kernel stack
      *
-     *         12 registers listed in push order
-     *         <kLR, kR4-kR12, PSP, CONTROL>
+     *         10 registers listed in push order
+     *         <kLR, kR4-kR11, PSP>
+     *         CONTROL is not saved, k_tsk_switch derives it from priv
      * -------------------------------------------------------------*/
     // a task never run before directly exit
     *(--ksp) = (U32) (&SVC_RTE);
-    // kernel stack R4 - R12, 9 registers
-#define NUM_REGS 9    // number of registers to push
+    // kernel stack R4 - R11, 8 registers
+#define NUM_REGS 8    // number of registers to push
       for ( int j = 0; j < NUM_REGS; j++) {        
 #ifdef DEBUG_0
         *(--ksp) = 0xDEADCCC0 + j;
@@ -375,16 +767,11 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
         
     // put user sp on to the kernel stack
     *(--ksp) = (U32) usp;
-    
-    // save control register so that we return with correct access level
-    if (p_taskinfo->priv == 1) {  // privileged 
-        *(--ksp) = __get_CONTROL() & ~BIT(0); 
-    } else {                      // unprivileged
-        *(--ksp) = __get_CONTROL() | BIT(0);
-    }
 
     p_tcb->msp = ksp;
+#endif /* K_SHARED_STACK */
 
+    p_tcb->state = READY;
     return RTX_OK;
 }
 
@@ -399,39 +786,63 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
  *              p_tcb_old == NULL or p_tcb_old->state updated
  * @note        caller must ensure the pre-conditions are met before calling.
  *              the function does not check the pre-condition!
- * @note        The control register setting will be done by the caller
+ * @note        only the callee-saved R4-R11 and PSP are kept on the kernel
+ *              stack. CONTROL follows the priv field and is written, with
+ *              its ISB, only when the two tasks differ in privilege.
  * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
  * @attention   CRITICAL SECTION
  * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
  *
  *****************************************************************************/
+#ifdef K_SHARED_STACK
+void k_tsk_switch(TCB *p_tcb_old)
+{
+    // SVC_Handler switches to gp_current_task on its way out
+}
+
+void k_tsk_start(void)
+{
+    // as above, the first task runs when the k_rtx_init SVC returns
+}
+#else
 __asm void k_tsk_switch(TCB *p_tcb_old)
 {
         PRESERVE8
         EXPORT  K_RESTORE
         
-        PUSH    {R4-R12, LR}                // save general pupose registers and return address
-        MRS     R4, CONTROL                 
-        MRS     R5, PSP
-        PUSH    {R4-R5}                     // save CONTROL, PSP
+        PUSH    {R4-R11, LR}                // save callee-saved registers and return address
+        MRS     R4, PSP
+        PUSH    {R4}                        // save PSP, 10 words keep SP 8B aligned
         STR     SP, [R0, #TCB_MSP_OFFSET]   // save SP to p_old_tcb->msp
+        LDRB    R3, [R0, #TCB_PRIV_OFFSET]  // privilege the CPU runs the old task at
 K_RESTORE
         LDR     R1, =__cpp(&gp_current_task)
         LDR     R2, [R1]
         LDR     SP, [R2, #TCB_MSP_OFFSET]   // restore msp of the gp_current_task
-        POP     {R4-R5}
-        MSR     PSP, R5                     // restore PSP
-        MSR     CONTROL, R4                 // restore CONTROL
+        LDRB    R1, [R2, #TCB_PRIV_OFFSET]
+        CMP     R1, R3
+        BEQ     K_SAME_PRIV                 // CONTROL.nPRIV already right
+        MRS     R3, CONTROL
+        CMP     R1, #0
+        ITE     EQ
+        ORREQ   R3, R3, #1                  // unprivileged
+        BICNE   R3, R3, #1                  // privileged
+        MSR     CONTROL, R3
         ISB                                 // flush pipeline, not needed for CM3 (architectural recommendation)
-        POP     {R4-R12, PC}                // restore general purpose registers and return address
+K_SAME_PRIV
+        POP     {R4}
+        MSR     PSP, R4                     // restore PSP
+        POP     {R4-R11, PC}                // restore callee-saved registers and return address
 }
 
 
 __asm void k_tsk_start(void)
 {
         PRESERVE8
+        MOV     R3, #0xFF                   // no old task, always write CONTROL
         B K_RESTORE
 }
+#endif /* K_SHARED_STACK */
 
 /**************************************************************************//**
  * @brief       run a new thread. The caller becomes READY and
@@ -461,12 +872,31 @@ int k_tsk_run_new(void)
 
     // at this point, gp_current_task != NULL and p_tcb_old != NULL
     if (gp_current_task != p_tcb_old) {
+        k_cpu_charge(&p_tcb_old->cpu_kernel);
+        if (p_tcb_old->state == DORMANT) {
+            g_cpu_exited += p_tcb_old->cpu_user + p_tcb_old->cpu_kernel;
+            p_tcb_old->cpu_user   = 0;
+            p_tcb_old->cpu_kernel = 0;
+        }
         gp_current_task->state = RUNNING;   // change state of the to-be-switched-in  tcb
+        if(p_tcb_old->state == RUNNING){
+            p_tcb_old->state = READY;       // a blocked task stays blocked
+        }
         if(p_tcb_old->state != DORMANT){
-            p_tcb_old->state = READY;
-            p_tcb_old->usp = __get_PSP();
+            p_tcb_old->u_sp = __get_PSP();
         }           // change state of the to-be-switched-out tcb
+#ifdef STACK_GUARD
+        k_stack_guard(gp_current_task);
+#endif /* STACK_GUARD */
+#ifdef SWITCH_PROFILE
+        g_switch_kind  = (p_tcb_old->priv << 1) | gp_current_task->priv;
+        g_switch_stamp = DWT->CYCCNT;
+#endif /* SWITCH_PROFILE */
         k_tsk_switch(p_tcb_old);            // switch kernel stacks       
+#ifdef SWITCH_PROFILE
+        // a first run task leaves through SVC_RTE and is not timed
+        k_switch_prof_end(DWT->CYCCNT - g_switch_stamp);
+#endif /* SWITCH_PROFILE */
     }
 
     return RTX_OK;
@@ -484,8 +914,8 @@ int k_tsk_run_new(void)
  *****************************************************************************/
 int k_tsk_yield(void)
 {
-    if(is_empty(&(array_of_queue[find_which_queue(gp_current_task->prio)])) == 0){
-        push_back(&(array_of_queue[find_which_queue(gp_current_task->prio)]), gp_current_task->tid);
+    if(is_empty(&(array_of_queue[PRIO_QUEUE(gp_current_task->prio)])) == 0){
+        push_back(&(array_of_queue[PRIO_QUEUE(gp_current_task->prio)]), gp_current_task->tid);
         return k_tsk_run_new();
     }
     return RTX_OK;
@@ -512,39 +942,54 @@ int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U32 stack_size
     printf("k_tsk_create: entering...\n\r");
     printf("task = 0x%x, task_entry = 0x%x, prio=%d, stack_size = %d\n\r", task, task_entry, prio, stack_size);
 #endif /* DEBUG_0 */
-    if (task == NULL || task_entry == NULL || (prio != HIGH && prio != MEDIUM && prio != LOW && prio != LOWEST)) {
+    TASK_INIT_EXT taskinfo;
+
+    taskinfo.init.ptask = task_entry;
+    taskinfo.init.prio = prio;
+    taskinfo.init.priv = 0;
+    taskinfo.init.u_stack_size = stack_size;
+    taskinfo.u_heap_size = 0;
+
+    return k_tsk_create_ext(task, &taskinfo);
+}
+
+/**
+ * @brief   create a task from a TASK_INIT_EXT, optionally with a private heap
+ * @note    only a privileged task may create a privileged task
+ */
+int k_tsk_create_ext(task_t *task, TASK_INIT_EXT *info)
+{
+    if (task == NULL || info == NULL || info->init.ptask == NULL) {
         errno = EINVAL;
         return RTX_ERR;
     }
-
-    if (g_num_active_tasks == MAX_TASKS) {
-        errno = EAGAIN;
+    
+    U8 prio = info->init.prio;
+    if (prio != HIGH && prio != MEDIUM && prio != LOW && prio != LOWEST) {
+        errno = EINVAL;
         return RTX_ERR;
     }
-    TASK_INIT taskinfo;
-    task_t tid = 0;
 
-    for (int i = 1; i < MAX_TASKS; ++i) {
-        if ( (g_tcbs[i].state != READY) && (g_tcbs[i].state != RUNNING)) {
-            tid = i;
-            break;
-        }
+    TCB *p_tcb = k_tsk_tcb_alloc();
+    if (p_tcb == NULL) {
+        return RTX_ERR;                 // errno set by k_tsk_tcb_alloc
     }
-    taskinfo.ptask = task_entry;
-    taskinfo.prio = prio;
-    taskinfo.priv = 0;
-    taskinfo.u_stack_size = stack_size;
+    TASK_INIT taskinfo = info->init;
+    task_t tid = p_tcb->tid;
+    
+    taskinfo.priv = (info->init.priv && gp_current_task->priv) ? 1 : 0;
 
-    if (k_tsk_create_new(&taskinfo, &g_tcbs[tid], tid) == RTX_OK) {
+    if (k_tsk_create_new(&taskinfo, p_tcb, tid, info->u_heap_size) == RTX_OK) {
         g_num_active_tasks++;
-        push_back(&(array_of_queue[prio-0x80]), tid);
+        push_back(&(array_of_queue[PRIO_QUEUE(prio)]), tid);
 		*task = tid;
     } else {
+        k_tsk_tcb_free(p_tcb);
         return RTX_ERR;
     }
 
     if(prio < gp_current_task->prio){
-        push_front(&(array_of_queue[find_which_queue(gp_current_task->prio)]), gp_current_task->tid);
+        push_front(&(array_of_queue[PRIO_QUEUE(gp_current_task->prio)]), gp_current_task->tid);
         k_tsk_run_new();
     }
 
@@ -561,10 +1006,20 @@ void k_tsk_exit(void)
         return;
     }
     gp_current_task -> state = DORMANT;
-    k_mpool_dealloc(MPID_IRAM2, (U32*)((U32)gp_current_task->u_sp_base-(U32)gp_current_task->u_stack_size));
+    gp_exited_task = gp_current_task;   // freed by the next SVC, see k_tsk_reap
+    k_mem_hfree_task(k_tsk_tag(gp_current_task->tid));
+    k_slab_flush_task(gp_current_task->tid);
+    if (gp_current_task->heap != MPID_NONE) {
+        k_heap_destroy(gp_current_task->heap);
+        gp_current_task->heap = MPID_NONE;
+    }
+#ifdef STACK_GUARD
+    k_stack_guard(NULL);    // the pools link the freed block through its guard words
+#endif /* STACK_GUARD */
+    k_stack_free((U32*)((U32)gp_current_task->u_sp_base-(U32)gp_current_task->u_stack_size), gp_current_task->u_stack_size);
     gp_current_task->u_stack_size=0;
     gp_current_task->u_sp_base=NULL;
-    gp_current_task->usp=0;
+    gp_current_task->u_sp=0;
     g_num_active_tasks--;
     k_tsk_run_new();
     return;
@@ -580,37 +1035,42 @@ int k_tsk_set_prio(task_t task_id, U8 prio)
         errno = EPERM;
         return RTX_ERR;
     }
-    if(task_id >= MAX_TASKS || (prio!=HIGH || prio!=MEDIUM || prio!=LOW || prio!=LOWEST) ){
+    if(prio!=HIGH && prio!=MEDIUM && prio!=LOW && prio!=LOWEST){
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    if(task_id >= MAX_TASKS || g_tcbs[task_id] == NULL){
         errno = EPERM;
         return RTX_ERR;
     }
 
-    if(gp_current_task->priv == 0 && g_tcbs[task_id]. priv == 1){
+    if(gp_current_task->priv == 0 && g_tcbs[task_id]->priv == 1){
         errno = EPERM;
         return RTX_ERR;
     }
 
-    if(g_tcbs[task_id].state == RUNNING){
-        if(current_priority_level() >= prio){
+    if(g_tcbs[task_id]->state == RUNNING){
+        int level = current_priority_level();
+        if(level < 0 || level >= PRIO_QUEUE(prio)){
             gp_current_task->prio = prio;
             return RTX_OK;
         }else{
             gp_current_task->prio = prio;
-            push_back(&(array_of_queue[prio-0x80]), gp_current_task->tid);
+            push_back(&(array_of_queue[PRIO_QUEUE(prio)]), gp_current_task->tid);
             return k_tsk_run_new();
         }
-    }else if(g_tcbs[task_id].state == READY){
-        if(g_tcbs[task_id].prio == prio){
+    }else if(g_tcbs[task_id]->state == READY){
+        if(g_tcbs[task_id]->prio == prio){
             return RTX_OK;
         }
-        find_and_delete(&(array_of_queue[find_which_queue(g_tcbs[task_id].prio)]), task_id);
-        push_back(&(array_of_queue[find_which_queue(prio)]), task_id);
+        find_and_delete(&(array_of_queue[PRIO_QUEUE(g_tcbs[task_id]->prio)]), task_id);
+        push_back(&(array_of_queue[PRIO_QUEUE(prio)]), task_id);
         if(gp_current_task->prio<=prio){
-            g_tcbs[task_id].prio = prio;
+            g_tcbs[task_id]->prio = prio;
             return RTX_OK;
         }else{
-            g_tcbs[task_id].prio = prio;
-            push_front(&(array_of_queue[find_which_queue(gp_current_task->prio)]), gp_current_task->tid);
+            g_tcbs[task_id]->prio = prio;
+            push_front(&(array_of_queue[PRIO_QUEUE(gp_current_task->prio)]), gp_current_task->tid);
             return k_tsk_run_new();
         }
     }else{
@@ -619,6 +1079,50 @@ int k_tsk_set_prio(task_t task_id, U8 prio)
     } 
 }
 
+/**
+ * @brief   copy the TCB of tid into a task information buffer
+ * @pre     tid is a valid task id, buffer is not NULL
+ */
+static void k_tsk_fill_info(task_t tid, RTX_TASK_INFO *buffer)
+{
+    TCB *p_tcb = g_tcbs[tid];
+    
+    buffer -> tid             = tid;
+    buffer -> prio            = p_tcb->prio;
+    buffer -> u_stack_size    = p_tcb->u_stack_size;
+    buffer -> priv            = p_tcb->priv;
+    buffer -> ptask           = p_tcb->ptask;
+    buffer -> k_sp_base       = p_tcb->k_sp_base;
+    buffer -> k_stack_size    = p_tcb->k_stack_size;
+    buffer -> state           = p_tcb->state;
+    buffer -> u_sp_base       = (U32)p_tcb->u_sp_base;
+
+    if (p_tcb == gp_current_task) {
+        buffer -> u_sp = __get_PSP();
+        buffer -> k_sp = __get_MSP();
+    } else {
+        buffer -> u_sp = p_tcb->u_sp;
+        buffer -> k_sp = (U32)p_tcb->msp;
+    }
+}
+
+/**
+ * @brief   copy the usage counters of tid into the extension fields
+ * @pre     tid is a valid task id, buffer is not NULL
+ */
+static void k_tsk_fill_info_ext(task_t tid, RTX_TASK_INFO_EXT *buffer)
+{
+    TCB *p_tcb = g_tcbs[tid];
+    
+    buffer -> mem_quota       = p_tcb->mem_quota;
+    buffer -> mem_used        = p_tcb->mem_used;
+    buffer -> cpu_user        = p_tcb->cpu_user;
+    buffer -> cpu_kernel      = p_tcb->cpu_kernel;
+    buffer -> u_stack_hwm     = (p_tcb->u_stack_size == 0) ? 0 :
+                                k_stack_hwm((U32)p_tcb->u_sp_base, p_tcb->u_stack_size - STACK_GUARD_SIZE);
+    buffer -> k_stack_hwm     = k_stack_hwm(p_tcb->k_sp_base, p_tcb->k_stack_size);
+}
+
 /**
  * @brief   Retrieve task internal information 
  * @note    this is a dummy implementation, you need to change the code
@@ -634,47 +1138,354 @@ int k_tsk_get(task_t tid, RTX_TASK_INFO *buffer)
         return RTX_ERR;
     }
 
-    if ( (g_tcbs[tid].state != DORMANT) && (g_tcbs[tid].state != READY) && (g_tcbs[tid].state != RUNNING)){
+    TCB *p_tcb = g_tcbs[tid];
+    if (p_tcb == NULL) {
+        // exited and freed, or never used
         errno = EINVAL;
         return RTX_ERR;
     }
-    /* The code fills the buffer with some fake task information. 
-       You should fill the buffer with correct information    */
-    buffer -> tid             = tid;
-    buffer -> prio            = g_tcbs[tid].prio;
-    buffer -> u_stack_size    = g_tcbs[tid].u_stack_size;
-    buffer -> priv            = g_tcbs[tid].priv;
-    buffer -> ptask           = g_tcbs[tid].ptask;
-    buffer -> k_sp_base       = (U32)g_k_stacks[tid + 1];
-    buffer -> k_stack_size    = KERN_STACK_SIZE;
-    buffer -> state           = g_tcbs[tid].state;
-    buffer -> u_sp_base       = (U32)g_tcbs[tid].u_sp_base;
-
-
-    if (k_tsk_gettid() == tid) {
-        buffer -> u_sp = __get_PSP();
-        buffer -> k_sp = __get_MSP();
-    } else {
-        buffer -> u_sp = g_tcbs[tid].usp;
-        buffer -> k_sp = (U32)g_tcbs[tid].msp;
+    if ( (p_tcb->state != DORMANT) && (p_tcb->state != READY) && (p_tcb->state != RUNNING) &&
+         (p_tcb->state != BLK_MEM)){
+        errno = EINVAL;
+        return RTX_ERR;
     }
+    k_tsk_fill_info(p_tcb->tid, buffer);
     return RTX_OK;     
 }
 
+/**
+ * @brief   tsk_get, plus the memory, CPU time and stack usage of the task
+ */
+int k_tsk_get_ext(task_t tid, RTX_TASK_INFO_EXT *buffer)
+{
+    if (buffer == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    if (k_tsk_get(tid, &buffer->info) != RTX_OK) {
+        return RTX_ERR;                 // errno set by k_tsk_get
+    }
+    k_tsk_fill_info_ext(tid, buffer);
+    return RTX_OK;
+}
+
+/**
+ * @brief   list the tids of the live tasks in ascending order
+ * @return  number of tids written to buf, at most count, RTX_ERR on error
+ * @note    the task table is only written in SVC context, which no other
+ *          kernel path preempts, so the list is a consistent snapshot
+ *          without masking interrupts
+ */
 int k_tsk_ls(task_t *buf, int count){
+    int n = 0;
+
 #ifdef DEBUG_0
     printf("k_tsk_ls: buf=0x%x, count=%d\r\n", buf, count);
 #endif /* DEBUG_0 */
-    return 0;
+
+    if (buf == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    if (count < 0) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+
+    for (int tid = k_tsk_next_live(0); tid < MAX_TASKS && n < count; tid = k_tsk_next_live(tid + 1)) {
+        buf[n++] = tid;
+    }
+    return n;
+}
+
+/**
+ * @brief   retrieve the task information of every live task in one call
+ * @return  number of entries written to buf, at most count, RTX_ERR on error
+ * @note    same snapshot guarantee as k_tsk_ls, entries are in tid order
+ */
+int k_tsk_get_all(RTX_TASK_INFO_EXT *buf, int count)
+{
+    int n = 0;
+
+    if (buf == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    if (count < 0) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+
+    for (int tid = k_tsk_next_live(0); tid < MAX_TASKS && n < count; tid = k_tsk_next_live(tid + 1)) {
+        k_tsk_fill_info(tid, &buf[n].info);
+        k_tsk_fill_info_ext(tid, &buf[n++]);
+    }
+    return n;
 }
 
 
+/**
+ * @brief   start the DWT cycle counter and clear the CPU time buckets
+ */
+void k_cpu_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+    g_cpu_isr    = 0;
+    g_cpu_exited = 0;
+    g_isr_nest   = 0;
+    g_cpu_stamp  = DWT->CYCCNT;
+}
+
+/**
+ * @brief   interrupt handlers call this first to have their time counted
+ *          in the ISR bucket instead of the interrupted task
+ * @see     k_isr_exit
+ */
+void k_isr_enter(void)
+{
+    U32 now = DWT->CYCCNT;
+    
+    if (g_isr_nest++ == 0) {
+        g_isr_stamp = now;
+    }
+}
+
+/**
+ * @brief   interrupt handlers call this last, pairs with k_isr_enter
+ * @note    the outermost exit moves g_cpu_stamp forward by the handler time
+ *          so the interrupted task is not charged for it
+ */
+void k_isr_exit(void)
+{
+    if (--g_isr_nest == 0) {
+        U32 elapsed = DWT->CYCCNT - g_isr_stamp;
+        g_cpu_isr   += elapsed;
+        g_cpu_stamp += elapsed;
+    }
+}
+
+#ifdef STACK_CHECK
+/**
+ * @brief   report live tasks whose user or kernel stack came within
+ *          STACK_CHECK_MARGIN bytes of its end, once per task
+ * @note    only the lowest STACK_CHECK_MARGIN bytes of each stack are read,
+ *          the STACK_GUARD words below them are not
+ */
+void k_tsk_stack_check(void)
+{
+    for (int tid = k_tsk_next_live(0); tid < MAX_TASKS; tid = k_tsk_next_live(tid + 1)) {
+        TCB   *p_tcb = g_tcbs[tid];
+        U32    u_lo  = (U32)p_tcb->u_sp_base - p_tcb->u_stack_size + STACK_GUARD_SIZE;
+        U32    k_lo  = p_tcb->k_sp_base - p_tcb->k_stack_size;
+        
+        if (p_tcb->stack_warned) {
+            continue;
+        }
+        if (k_stack_hwm(u_lo + STACK_CHECK_MARGIN, STACK_CHECK_MARGIN) != 0 ||
+            (p_tcb->k_stack_size != 0 &&
+             k_stack_hwm(k_lo + STACK_CHECK_MARGIN, STACK_CHECK_MARGIN) != 0)) {
+            p_tcb->stack_warned = TRUE;
+            printf("stack check: tid %d within 0x%x bytes of overflow\r\n", tid, STACK_CHECK_MARGIN);
+        }
+    }
+}
+#endif /* STACK_CHECK */
+
+#ifdef STACK_GUARD
+/**
+ * @brief   turn on the MPU with full access background regions and enable
+ *          the MemManage fault
+ * @note    PRIVDEFENA only gives the default map to privileged accesses,
+ *          unprivileged tasks run on the background regions. The private
+ *          peripheral bus always uses the default map
+ */
+void k_mpu_init(void)
+{
+    static const U32 base[MPU_BG_REGIONS] = { 0x00000000, 0x20000000, 0x40000000 };
+    static const U32 attr[MPU_BG_REGIONS] = {
+        MPU_RASR_C_Msk,                                     // flash and IRAM1, normal write through
+        MPU_RASR_C_Msk | MPU_RASR_B_Msk,                    // IRAM2 and GPIO, normal write back
+        MPU_RASR_XN_Msk | MPU_RASR_S_Msk | MPU_RASR_B_Msk   // APB and AHB peripherals, device
+    };
+    
+    for (int i = 0; i < MPU_BG_REGIONS; i++) {
+        MPU->RBAR = base[i] | MPU_RBAR_VALID_Msk | i;
+        MPU->RASR = attr[i] | (MPU_AP_FULL << MPU_RASR_AP_Pos) |
+                    ((MPU_BG_LOG2 - 1) << MPU_RASR_SIZE_Pos) | MPU_RASR_ENABLE_Msk;
+    }
+    MPU->CTRL   = MPU_CTRL_ENABLE_Msk | MPU_CTRL_PRIVDEFENA_Msk;
+    SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk;
+    __DSB();
+    __ISB();
+}
+
+/**
+ * @brief   place the no access MPU guard over the lowest STACK_GUARD_SIZE
+ *          bytes of a task user stack
+ * @param   p_tcb   the task to guard, NULL removes the guard
+ * @note    user stacks are runs of buddy blocks, the biggest at the low end
+ *          and at least MIN_BLK_SIZE, so the low end is always aligned enough
+ *          for the region base. The guard sits inside that first block,
+ *          never over a neighbour block.
+ */
+void k_stack_guard(TCB *p_tcb)
+{
+    if (p_tcb == NULL || p_tcb->u_stack_size == 0) {
+        MPU->RNR  = STACK_GUARD_REGION;
+        MPU->RASR = 0;
+    } else {
+        MPU->RBAR = ((U32)p_tcb->u_sp_base - p_tcb->u_stack_size) | MPU_RBAR_VALID_Msk | STACK_GUARD_REGION;
+        MPU->RASR = MPU_RASR_XN_Msk | ((STACK_GUARD_LOG2 - 1) << MPU_RASR_SIZE_Pos) | MPU_RASR_ENABLE_Msk;
+    }
+    __DSB();
+    __ISB();
+}
+
+/**
+ * @brief   MemManage fault, a task ran into its stack guard
+ * @note    the fault address names the task when the MPU latched it,
+ *          otherwise the fault hit while stacking for the running task
+ */
+void MemManage_Handler(void)
+{
+    U32  cfsr  = SCB->CFSR;
+    U32  addr  = SCB->MMFAR;
+    TCB *p_tcb = gp_current_task;
+    
+    if (cfsr & SCB_CFSR_MMARVALID_Msk) {
+        for (int tid = k_tsk_next_live(0); tid < MAX_TASKS; tid = k_tsk_next_live(tid + 1)) {
+            U32 lo = (U32)g_tcbs[tid]->u_sp_base - g_tcbs[tid]->u_stack_size;
+            if (g_tcbs[tid]->u_stack_size != 0 && addr - lo < STACK_GUARD_SIZE) {
+                p_tcb = g_tcbs[tid];
+                break;
+            }
+        }
+    }
+    printf("stack guard: tid %d overflowed its user stack, cfsr = 0x%x, addr = 0x%x\r\n",
+           (p_tcb == NULL) ? -1 : p_tcb->tid, cfsr, addr);
+    while (1);
+}
+#endif /* STACK_GUARD */
+
+#ifdef SWITCH_PROFILE
+/**
+ * @brief   print the k_tsk_switch timings, one line per privilege pair
+ * @return  number of pairs with timed switches
+ * @note    cycles run from just before k_tsk_switch in the old task to
+ *          its return in the new one, one cycle counter read included
+ */
+int k_tsk_switch_prof_dump(void)
+{
+    static const char *kinds[SWITCH_KINDS] = {
+        "unpriv->unpriv", "unpriv->priv", "priv->unpriv", "priv->priv"
+    };
+    int num = 0;
+    
+    for (int i = 0; i < SWITCH_KINDS; i++) {
+        SWITCH_STAT *stat = &g_switch_stats[i];
+        if (stat->count != 0) {
+            printf("switch prof: %s: count %d, min %d, avg %d, max %d\r\n", kinds[i],
+                   stat->count, stat->min, (U32)(stat->total / stat->count), stat->max);
+            num++;
+        }
+    }
+    return num;
+}
+
+/**
+ * @brief   copy the k_tsk_switch timings to buf, then clear them if reset
+ * @param   buf     SWITCH_KINDS entries, NULL to only clear
+ */
+int k_tsk_switch_stat(SWITCH_STAT *buf, BOOL reset)
+{
+    if (buf == NULL && !reset) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    if (buf != NULL) {
+        for (int i = 0; i < SWITCH_KINDS; i++) {
+            buf[i] = g_switch_stats[i];
+        }
+    }
+    if (reset) {
+        k_mem_zero(g_switch_stats, sizeof(g_switch_stats));
+    }
+    return RTX_OK;
+}
+#endif /* SWITCH_PROFILE */
+
+/**
+ * @brief   per mille of total that part is, for the k_tsk_top percentages
+ */
+static U32 k_cpu_permille(U64 part, U64 total)
+{
+    return (total == 0) ? 0 : (U32)((part * 1000) / total);
+}
+
+/**
+ * @brief   print a top like CPU time summary of the live tasks to the UART
+ * @return  RTX_OK
+ * @note    times are in thousands of DWT cycles, the null task is the idle time
+ */
+int k_tsk_top(void)
+{
+    int tid;
+    U64 total = g_cpu_isr + g_cpu_exited;
+    U64 idle  = g_tcbs[TID_NULL]->cpu_user + g_tcbs[TID_NULL]->cpu_kernel;
+    U32 pm;
+    
+    for (tid = k_tsk_next_live(0); tid < MAX_TASKS; tid = k_tsk_next_live(tid + 1)) {
+        total += g_tcbs[tid]->cpu_user + g_tcbs[tid]->cpu_kernel;
+    }
+    
+    printf("tid prio state    user kc  kernel kc    cpu\r\n");
+    for (tid = k_tsk_next_live(0); tid < MAX_TASKS; tid = k_tsk_next_live(tid + 1)) {
+        TCB   *p_tcb = g_tcbs[tid];
+        pm = k_cpu_permille(p_tcb->cpu_user + p_tcb->cpu_kernel, total);
+        printf("%3d 0x%x %5d %10u %10u %4u.%u%%\r\n", tid, p_tcb->prio, p_tcb->state,
+               (U32)(p_tcb->cpu_user / 1000), (U32)(p_tcb->cpu_kernel / 1000), pm / 10, pm % 10);
+    }
+    // this build polls the UART and has no timer IRQ, so nothing calls
+    // k_isr_enter yet, the row shows up once a handler is bracketed
+    if (g_cpu_isr != 0) {
+        pm = k_cpu_permille(g_cpu_isr, total);
+        printf("isr %30u %4u.%u%%\r\n", (U32)(g_cpu_isr / 1000), pm / 10, pm % 10);
+    }
+    pm = k_cpu_permille(g_cpu_exited, total);
+    printf("exited %27u %4u.%u%%\r\n", (U32)(g_cpu_exited / 1000), pm / 10, pm % 10);
+    pm = k_cpu_permille(idle, total);
+    printf("total %u kc, idle %u.%u%%\r\n", (U32)(total / 1000), pm / 10, pm % 10);
+    return RTX_OK;
+}
+
+/**
+ * @brief   copy the scheduler histograms and optionally start them over
+ * @param   buf     where to copy them, may be NULL when reset is set
+ * @param   reset   clear the histograms after the copy
+ * @return  RTX_OK on success, RTX_ERR on error
+ */
+int k_sched_hist(SCHED_HIST *buf, BOOL reset)
+{
+    if (buf == NULL && !reset) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    if (buf != NULL) {
+        *buf = g_sched_hist;
+    }
+    if (reset) {
+        k_mem_zero(&g_sched_hist, sizeof(g_sched_hist));
+    }
+    return RTX_OK;
+}
+
 int is_empty(Queue* q){
     return q->size == 0;
 }
 
 void queue_init(void){
-    for (int i=0; i<= PRIORITY_NUM; i++){
+    for (int i=0; i< PRIORITY_NUM; i++){
         array_of_queue[i].start = NULL;
         array_of_queue[i].end = NULL;
         array_of_queue[i].size = 0;
@@ -718,6 +1529,7 @@ void push_back(Queue* q, task_t tid){
         q->end = temp;
     }
     (q->size)++;
+    k_sched_enqueued(q, tid);
 }
 
 void push_front(Queue* q, task_t tid){
@@ -731,6 +1543,7 @@ void push_front(Queue* q, task_t tid){
         q->start = temp;
     }
     (q->size)++;
+    k_sched_enqueued(q, tid);
 }
 
 int is_inside_queue(Queue* q, task_t tid){
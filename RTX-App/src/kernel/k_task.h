@@ -69,10 +69,16 @@ extern TCB *gp_current_task;
 extern void task_null	(void);
 
 
+/* define K_SHARED_STACK to run every SVC on one kernel stack, g_k_stack,
+   instead of a kernel stack per task. A switched out task keeps R4-R11 on
+   its user stack below its exception frame and SVC_Handler swaps tasks on
+   its way out, so the kernel code after k_tsk_run_new still runs for the
+   old task and blocking calls return when the task is switched back in */
+
 // Implemented by Starter Code
 int  k_tsk_init         (TASK_INIT *task_info, int num_tasks);
                                  /* initialize all tasks in the system */
-int  k_tsk_create_new   (TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid);
+int  k_tsk_create_new   (TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid, U32 u_heap_size);
                                  /* create a new task with initial context sitting on a dummy stack frame */
 TCB *scheduler          (void);  /* return the TCB of the next ready to run task */
 void k_tsk_switch       (TCB *); /* kernel thread context switch, two stacks */
@@ -82,14 +88,103 @@ void task_null          (void);  /* the null task */
 void k_tsk_init_first   (TASK_INIT *p_task);    /* init the first task */
 void k_tsk_start        (void);  /* start the first task */
 task_t k_tsk_gettid     (void);  /* get tid of the current running task */
+task_t k_tsk_tag        (task_t slot);  /* owner tag of a TCB.tid slot */
+TCB   *k_tsk_lookup     (task_t tag);   /* TCB of an owner tag, NULL if unused or stale */
 
 // Not implemented, to be done by students
 int  k_tsk_create       (task_t *task, void (*task_entry)(void), U8 prio, U32 stack_size);
+int  k_tsk_create_ext   (task_t *task, TASK_INIT_EXT *info);
 void k_tsk_exit         (void);
 int  k_tsk_set_prio     (task_t task_id, U8 prio);
 int  k_tsk_get          (task_t task_id, RTX_TASK_INFO *buffer);
+int  k_tsk_ls           (task_t *buf, int count);
+int  k_tsk_get_ext      (task_t task_id, RTX_TASK_INFO_EXT *buffer);
+int  k_tsk_get_all      (RTX_TASK_INFO_EXT *buf, int count);
+int  k_tsk_top          (void);
+int  k_sched_hist       (SCHED_HIST *buf, BOOL reset);
+void k_cpu_init         (void);  /* start the DWT cycle counter */
+void k_isr_enter        (void);  /* first call of an IRQ handler */
+void k_isr_exit         (void);  /* last call of an IRQ handler */
+#ifdef STACK_CHECK
+void k_tsk_stack_check  (void);  /* null task overflow watch */
+#endif /* STACK_CHECK */
+#ifdef SWITCH_PROFILE
+int  k_tsk_switch_prof_dump (void);
+int  k_tsk_switch_stat      (SWITCH_STAT *buf, BOOL reset);
+#endif /* SWITCH_PROFILE */
+#ifdef STACK_GUARD
+void k_mpu_init         (void);  /* MPU on, MemManage fault enabled */
+void k_stack_guard      (TCB *p_tcb);   /* move the MPU guard, NULL disables it */
+#endif /* STACK_GUARD */
+#ifdef K_SHARED_STACK
+void k_tsk_set_ret      (TCB *p_tcb, U32 ret);  /* return value of a switched out task */
+#endif /* K_SHARED_STACK */
 TCB *scheduler          (void);  /* student needs to change this function */
 
+#define TID_WORDS       ((MAX_TASKS + 31) >> 5) /* words of g_tid_free */
+#define TID_WORD(tid)   ((tid) >> 5)            /* g_tid_free word of a tid */
+#define TID_BIT(tid)    (0x80000000U >> ((tid) & 0x1F))
+                                    /* bit of a tid in its word, __clz finds the lowest free */
+
+/* tids handed to tasks are slots below MAX_TASKS, which the AE task tables
+   index by. Records that outlive a task, such as the memory owner maps, keep
+   an owner tag instead: the tid with the generation of its slot above the
+   slot bits. A slot's generation is bumped when its TCB is freed, so a tag
+   kept after its task exited does not name the task that reuses the slot.
+   A larger MAX_TASKS leaves fewer generations below TID_UART_IRQ, none at
+   all above 0x80 */
+#if MAX_TASKS <= 0x10
+#define TID_SLOT_BITS   4
+#elif MAX_TASKS <= 0x20
+#define TID_SLOT_BITS   5
+#elif MAX_TASKS <= 0x40
+#define TID_SLOT_BITS   6
+#elif MAX_TASKS <= 0x80
+#define TID_SLOT_BITS   7
+#else
+#define TID_SLOT_BITS   8
+#endif
+#define TID_SLOT_MASK   ((1 << TID_SLOT_BITS) - 1)
+#define TID_GENS        ((TID_UART_IRQ >> TID_SLOT_BITS) ? (TID_UART_IRQ >> TID_SLOT_BITS) : 1)
+                                    /* generations a slot cycles through */
+#define TID_OF_TAG(tag) (((tag) < TID_UART_IRQ) ? ((tag) & TID_SLOT_MASK) : (tag))
+                                    /* tid of an owner tag, TID_KERN and the like as they are */
+
+#define STACK_PAINT     0xC5C5C5C5U /* fill of unused stack words, see k_stack_hwm */
+#ifdef STACK_GUARD
+#define STACK_GUARD_LOG2   5        /* MPU no access region at the bottom of the running user stack */
+#define STACK_GUARD_SIZE   (1 << STACK_GUARD_LOG2)
+#define MPU_BG_REGIONS     3        /* full access MPU regions 0-2: code, SRAM, peripherals */
+#define MPU_BG_LOG2        29       /* each background region covers 512MB */
+#define MPU_AP_FULL        0x3      /* RASR.AP read/write for privileged and unprivileged */
+#define STACK_GUARD_REGION MPU_BG_REGIONS   /* MPU region number of the guard, above the
+                                               background regions so it wins the overlap */
+#else
+#define STACK_GUARD_SIZE   0
+#endif /* STACK_GUARD */
+/* define SWITCH_PROFILE to time k_tsk_switch with the DWT cycle counter,
+   per old and new task privilege, see tsk_switch_prof_dump */
+#ifdef SWITCH_PROFILE
+#ifdef K_SHARED_STACK
+#error "SWITCH_PROFILE times k_tsk_switch, which K_SHARED_STACK does not use"
+#endif
+#endif /* SWITCH_PROFILE */
+
+#ifndef STACK_CHECK_MARGIN
+#define STACK_CHECK_MARGIN 0x40     /* STACK_CHECK warns when a task gets this close to the end */
+#endif
+
+#if MAX_TASKS > TID_UART_IRQ
+#error "task ids are U8 and TID_UART_IRQ and above are reserved"
+#endif
+
+extern U32 g_tid_free[TID_WORDS];
+extern U8  g_tid_gen[MAX_TASKS];
+
+#define PRIORITY_NUM    5           /* ready queues, HIGH..LOWEST then the null task */
+#define PRIO_QUEUE(prio) (((prio) == PRIO_NULL) ? PRIORITY_NUM - 1 : (prio) - HIGH)
+                                    /* array_of_queue index of a priority */
+
 typedef struct task_node TaskNode;
 
 struct task_node{
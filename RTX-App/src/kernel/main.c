@@ -48,6 +48,15 @@
 #include "ae.h"
 
 #define NUM_INIT_TASKS 2
+/* define SELF_TEST to run the kernel self tests in a HIGH task after the
+   AE tasks, see tasks/self_test.c */
+#ifdef SELF_TEST
+#define NUM_SELF_TESTS 1    /* task_self_test, after the AE tasks */
+
+extern void set_self_test_task(TASK_INIT *task);
+#else
+#define NUM_SELF_TESTS 0
+#endif /* SELF_TEST */
 
 /**************************************************************************//**
  * @brief   	main routine
@@ -58,7 +67,7 @@ int main()
 {   
     /* initial tasks */
     static RTX_SYS_INFO sys;
-    static TASK_INIT tasks[NUM_INIT_TASKS];
+    static TASK_INIT tasks[NUM_INIT_TASKS + NUM_SELF_TESTS];
     
     /* CMSIS system initialization */
     SystemInit();   
@@ -80,11 +89,14 @@ int main()
 #endif // DEBUG_1    
     /* initialize the third-party testing framework */
     ae_init(&sys, tasks , NUM_INIT_TASKS, &k_pre_rtx_init, NULL);   
+#ifdef SELF_TEST
+    set_self_test_task(&tasks[NUM_INIT_TASKS]);
+#endif /* SELF_TEST */
    
     __set_CONTROL(__get_CONTROL() | BIT(1));
     __isb(15); // see https://www.keil.com/support/man/docs/armcc/armcc_chr1435075770601.htm#:~:text=This%20intrinsic%20inserts%20an%20ISB,is%20also%20an%20optimization%20barrier.
     /* start the RTX */
-    rtx_init(&sys, tasks, NUM_INIT_TASKS);
+    rtx_init(&sys, tasks, NUM_INIT_TASKS + NUM_SELF_TESTS);
 
    
     /* We should never reach here!!! */
@@ -0,0 +1,89 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2021 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        arena.c
+ * @brief       Arena (region) allocator user library
+ *
+ * @version     V1.2021.05
+ * @authors     Yiqing Huang
+ * @date        2021 MAY
+ *
+ * @note        runs in thread mode, only create and destroy trap into the
+ *              kernel
+ *
+ *****************************************************************************/
+
+#include "arena.h"
+
+#define ARENA_HDR_SIZE  ((sizeof(MEM_ARENA) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/**************************************************************************//**
+ * @brief       create an arena backed by a single mem_alloc block
+ * @param       size    number of bytes the arena can hand out
+ * @return      the arena, NULL on failure with errno set by mem_alloc,
+ *              NULL if the header would wrap size around
+ *****************************************************************************/
+MEM_ARENA *mem_arena_create(size_t size)
+{
+    MEM_ARENA *arena;
+    
+    if (size > (size_t)0xFFFFFFFF - ARENA_HDR_SIZE) {
+        return NULL;
+    }
+    arena = mem_alloc(ARENA_HDR_SIZE + size);
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->end = (U8 *)arena + ARENA_HDR_SIZE + size;
+    mem_arena_reset(arena);
+    return arena;
+}
+
+/**************************************************************************//**
+ * @brief       allocate n bytes from an arena, ARENA_ALIGN aligned
+ * @return      the object, NULL if n is 0 or the arena is full
+ *****************************************************************************/
+void *mem_arena_alloc(MEM_ARENA *arena, size_t n)
+{
+    U8 *ptr = arena->cur;
+    
+    n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (n == 0 || n > (size_t)(arena->end - ptr)) {
+        return NULL;
+    }
+    arena->cur = ptr + n;
+    return ptr;
+}
+
+/**************************************************************************//**
+ * @brief       free all objects of an arena, the arena stays usable
+ *****************************************************************************/
+void mem_arena_reset(MEM_ARENA *arena)
+{
+    arena->cur = (U8 *)arena + ARENA_HDR_SIZE;
+}
+
+/**************************************************************************//**
+ * @brief       free all objects of an arena and the arena itself
+ * @return      RTX_OK on success and RTX_ERR on failure
+ *****************************************************************************/
+int mem_arena_destroy(MEM_ARENA *arena)
+{
+    return mem_dealloc(arena);
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
@@ -0,0 +1,130 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2021 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        fbpool.c
+ * @brief       Interrupt safe fixed-block pool library
+ *
+ * @version     V1.2021.05
+ * @authors     Yiqing Huang
+ * @date        2021 MAY
+ *
+ * @note        alloc and free are safe in thread and handler mode. The
+ *              exclusive monitor is cleared on every exception entry and
+ *              return, so a STREX fails whenever an ISR ran between it and
+ *              its LDREX, which also rules out ABA on the free list head.
+ *
+ *****************************************************************************/
+
+#include "fbpool.h"
+
+#define FBPOOL_HDR_SIZE ((sizeof(MEM_FBPOOL) + FBPOOL_ALIGN - 1) & ~(FBPOOL_ALIGN - 1))
+
+/**************************************************************************//**
+ * @brief       set up a pool of num blocks over caller provided storage
+ * @param       buf     FBPOOL_ALIGN aligned storage of at least num blocks,
+ *                      blk_size rounded up to FBPOOL_ALIGN each
+ * @return      RTX_OK on success and RTX_ERR on failure
+ * @note        not interrupt safe, no ISR may use the pool during init
+ *****************************************************************************/
+int mem_fbpool_init(MEM_FBPOOL *pool, void *buf, size_t blk_size, size_t num)
+{
+    if (pool == NULL || buf == NULL || blk_size == 0 || num == 0 ||
+        ((U32)buf & (FBPOOL_ALIGN - 1)) != 0) {
+        return RTX_ERR;
+    }
+    
+    blk_size = (blk_size + FBPOOL_ALIGN - 1) & ~(FBPOOL_ALIGN - 1);
+    pool->blk_size = blk_size;
+    pool->start = buf;
+    pool->end = (U8 *)buf + blk_size * num;
+    
+    // link the blocks in address order
+    FB_NODE *node = NULL;
+    for (size_t i = num; i > 0; i--) {
+        FB_NODE *blk = (FB_NODE *)(pool->start + (i - 1) * blk_size);
+        blk->next = node;
+        node = blk;
+    }
+    pool->head = node;
+    return RTX_OK;
+}
+
+/**************************************************************************//**
+ * @brief       create a pool of num blocks backed by a single mem_alloc block
+ * @return      the pool, NULL on failure
+ *****************************************************************************/
+MEM_FBPOOL *mem_fbpool_create(size_t blk_size, size_t num)
+{
+    size_t size = (blk_size + FBPOOL_ALIGN - 1) & ~(FBPOOL_ALIGN - 1);
+    
+    if (size == 0 || num == 0 || size * num / num != size) {
+        return NULL;
+    }
+    MEM_FBPOOL *pool = mem_alloc(FBPOOL_HDR_SIZE + size * num);
+    if (pool == NULL) {
+        return NULL;
+    }
+    mem_fbpool_init(pool, (U8 *)pool + FBPOOL_HDR_SIZE, size, num);
+    return pool;
+}
+
+/**************************************************************************//**
+ * @brief       take a block from the pool, callable from ISRs
+ * @return      the block, NULL if the pool is empty
+ *****************************************************************************/
+void *mem_fbpool_alloc(MEM_FBPOOL *pool)
+{
+    FB_NODE *node;
+    
+    do {
+        node = (FB_NODE *)__ldrex((void *)&pool->head);
+        if (node == NULL) {
+            __clrex();
+            return NULL;
+        }
+    } while (__strex((U32)node->next, (void *)&pool->head) != 0);
+    return node;
+}
+
+/**************************************************************************//**
+ * @brief       give a block back to its pool, callable from ISRs
+ * @return      RTX_OK on success and RTX_ERR if blk is not a block of pool
+ *****************************************************************************/
+int mem_fbpool_free(MEM_FBPOOL *pool, void *blk)
+{
+    FB_NODE *node = blk;
+    
+    if ((U8 *)blk < pool->start || (U8 *)blk >= pool->end ||
+        ((U8 *)blk - pool->start) % pool->blk_size != 0) {
+        return RTX_ERR;
+    }
+    do {
+        node->next = (FB_NODE *)__ldrex((void *)&pool->head);
+    } while (__strex((U32)node, (void *)&pool->head) != 0);
+    return RTX_OK;
+}
+
+/**************************************************************************//**
+ * @brief       free a pool made by mem_fbpool_create and all its blocks
+ * @return      RTX_OK on success and RTX_ERR on failure
+ *****************************************************************************/
+int mem_fbpool_destroy(MEM_FBPOOL *pool)
+{
+    return mem_dealloc(pool);
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
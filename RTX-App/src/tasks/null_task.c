@@ -52,6 +52,7 @@ void task_null(void)
             printf("==============Task NULL: TID = %d ===============\r\n", tid);
         }
 #endif
+        rtx_idle();
         tsk_yield();
     }
 }
@@ -0,0 +1,250 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2021 Yiqing Huang
+ *                          All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  - Redistributions of source code must retain the above copyright
+ *    notice and the following disclaimer.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        self_test.c
+ * @brief       A boot task that runs the kernel self tests, then exits
+ *
+ * @note        The tests live here rather than in the AE library, which the
+ *              app links as a prebuilt library, so that an app build can
+ *              compile and run them. Define SELF_TEST to add the task, the
+ *              file is empty otherwise.
+ *
+ *****************************************************************************/
+
+#ifdef SELF_TEST
+
+#include "rtx.h"
+#include "uart_polling.h"
+#include "printf.h"
+#include "../kernel/k_mem.h"    // slab page layout, for test_mem_slab
+
+/**
+ * @brief   one small object of each size class must leave most of the
+ *          4KB user heap free. 5 small objects take 0x1E0 bytes at most,
+ *          so 0x800, 0x400 and 0x200 blocks still fit next to them.
+ * @return  bit[n] set means test n passed, 0x1F if all passed
+ * @note    case 0: every small object is allocated
+ *          case 1: the MPID_IRAM1 slab classes, up to SLAB_MAX_SIZE_RAM1,
+ *                  come from a slab page of their own size, the larger
+ *                  ones from the buddy tree
+ *          case 2-4: the 0x800, 0x400 and 0x200 blocks are allocated
+ */
+int test_mem_slab(void) {
+    static void *obj[5];
+    static void *blk[3];
+    U32 result = 0;
+    
+    result |= BIT(0) | BIT(1);
+    for ( int i = 0; i < 5; i++ ) {
+        U32 size = 8 << i;              // 8, 16, 32, 64 and 128 bytes
+        
+        obj[i] = mem_alloc(size);
+        if (obj[i] == NULL) {
+            result &= ~(BIT(0) | BIT(1));
+            continue;
+        }
+#ifndef DEBUG_HEAP      // the debug header moves objects out of their class
+        if (size <= SLAB_MAX_SIZE_RAM1) {
+            // the page header is never handed out and names the size class
+            SLAB *slab = (SLAB *)((U32)obj[i] & ~((1 << SLAB_PAGE_LOG2_RAM1) - 1));
+            if ((void *)slab == obj[i] || slab->obj_size != size) {
+                result &= ~BIT(1);
+            }
+        }
+#endif /* DEBUG_HEAP */
+    }
+    
+    for ( int i = 0; i < 3; i++ ) {
+        blk[i] = mem_alloc(0x800 >> i);
+        if (blk[i] != NULL) {
+            result |= BIT(i + 2);
+        }
+    }
+    
+    for ( int i = 0; i < 3; i++ ) {
+        mem_dealloc(blk[i]);
+    }
+    for ( int i = 0; i < 5; i++ ) {
+        mem_dealloc(obj[i]);
+    }
+    
+    printf("test_mem_slab: END: 5 cases, result = 0x%x\r\n", result);
+    return result;
+}
+
+/**
+ * @brief   check that a context switch shows up in the scheduler's
+ *          ready-to-dispatch wait histograms
+ * @return  1 if some dispatch was recorded, 0 otherwise
+ */
+int test_sched_hist(void)
+{
+    static SCHED_HIST hist;     /* our stack space is small, so make it static local */
+    U32 count = 0;
+    
+    sched_hist(NULL, TRUE);     // start from empty histograms
+    tsk_yield();
+    if (sched_hist(&hist, FALSE) != RTX_OK) {
+        printf("test_sched_hist: sched_hist failed\r\n");
+        return 0;
+    }
+    for (int i = 0; i < SCHED_HIST_LEVELS; i++) {
+        for (int j = 0; j < SCHED_WAIT_BUCKETS; j++) {
+            count += hist.wait[i][j];
+        }
+    }
+    printf("test_sched_hist: %d dispatch(es) recorded, %s\r\n", count, 
+           (count > 0) ? "PASS" : "FAIL");
+    return (count > 0);
+}
+
+#ifdef SWITCH_PROFILE
+#define SWITCH_BENCH_TASKS  6       /* two priv, two unpriv, one mixed pair */
+#define SWITCH_BENCH_ROUNDS 100     /* yields per benchmark task */
+/* k_tsk_switch cycle budgets, stamp to stamp. Cortex-M3 instruction
+   timings at zero wait states give about 53 cycles when CONTROL is kept
+   and 62 when it is written, the rest is slack for flash accelerator
+   misses on the board */
+#define SWITCH_BUDGET_SAME  64      /* priv->priv and unpriv->unpriv */
+#define SWITCH_BUDGET_MIXED 80      /* privilege changes, CONTROL write and ISB */
+
+/**
+ * @brief   a benchmark task, yields SWITCH_BENCH_ROUNDS times and exits
+ */
+void task_switch_bench(void)
+{
+    for (int i = 0; i < SWITCH_BENCH_ROUNDS; i++) {
+        tsk_yield();
+    }
+    tsk_exit();
+}
+
+/**
+ * @brief   print one row of test_switch_bench
+ * @return  1 if the average switch is within budget, 0 otherwise
+ */
+static int switch_bench_report(char *what, SWITCH_STAT *stat, U32 budget)
+{
+    U32 avg  = (stat->count == 0) ? 0 : (U32)(stat->total / stat->count);
+    int pass = (stat->count != 0 && avg <= budget);
+    
+    printf("test_switch_bench: %s: count %d, min %d, avg %d, max %d, budget %d, %s\r\n",
+           what, stat->count, stat->min, avg, stat->max, budget, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/**
+ * @brief   time k_tsk_switch for each privilege pair. Two privileged,
+ *          two unprivileged and one mixed pair of HIGH tasks yield to
+ *          each other until they exit
+ * @return  bit[n] set means figure n is within budget, 0x7 if all are
+ */
+int test_switch_bench(void)
+{
+    static const U8 privs[SWITCH_BENCH_TASKS] = { 1, 1, 0, 0, 1, 0 };
+    static SWITCH_STAT stat[SWITCH_KINDS];
+    static RTX_TASK_INFO info;  /* our stack space is small, so make it static local */
+    task_t tids[SWITCH_BENCH_TASKS];
+    TASK_INIT_EXT task;
+    int live = 0;
+    U32 result = 0;
+    
+    task.init.ptask        = &task_switch_bench;
+    task.init.u_stack_size = PROC_STACK_SIZE;
+    task.init.prio         = HIGH;
+    task.u_heap_size       = 0;
+    for (int i = 0; i < SWITCH_BENCH_TASKS; i++) {
+        task.init.priv = privs[i];
+        if (tsk_create_ext(&tids[i], &task) != RTX_OK) {
+            printf("test_switch_bench: tsk_create_ext failed\r\n");
+            return 0;
+        }
+    }
+    
+    tsk_switch_stat(NULL, TRUE);    // time only the switches from here on
+    do {
+        tsk_yield();
+        live = 0;
+        // an exited task is reaped, so tsk_get fails on its stale tid
+        for (int i = 0; i < SWITCH_BENCH_TASKS; i++) {
+            if (tsk_get(tids[i], &info) == RTX_OK && info.state != DORMANT) {
+                live++;
+            }
+        }
+    } while (live != 0);
+    tsk_switch_stat(stat, FALSE);
+    
+    // the mixed figure takes both directions, unpriv->priv and priv->unpriv
+    if (stat[2].count != 0 && (stat[1].count == 0 || stat[2].min < stat[1].min)) {
+        stat[1].min = stat[2].min;
+    }
+    if (stat[2].max > stat[1].max) {
+        stat[1].max = stat[2].max;
+    }
+    stat[1].count += stat[2].count;
+    stat[1].total += stat[2].total;
+    
+    result |= switch_bench_report("priv->priv", &stat[3], SWITCH_BUDGET_SAME) << 0;
+    result |= switch_bench_report("unpriv->unpriv", &stat[0], SWITCH_BUDGET_SAME) << 1;
+    result |= switch_bench_report("mixed", &stat[1], SWITCH_BUDGET_MIXED) << 2;
+    return result;
+}
+#endif /* SWITCH_PROFILE */
+
+/**
+ * @brief   run each self test once, then exit
+ */
+void task_self_test(void)
+{
+    test_mem_slab();
+    test_sched_hist();
+#ifdef SWITCH_PROFILE
+    test_switch_bench();
+#endif /* SWITCH_PROFILE */
+    tsk_exit();
+}
+
+/**
+ * @brief   fill in the TASK_INIT of the self test task
+ */
+void set_self_test_task(TASK_INIT *task)
+{
+    task->ptask        = &task_self_test;
+    task->u_stack_size = PROC_STACK_SIZE;
+    task->prio         = HIGH;
+    task->priv         = 1;
+}
+
+#endif /* SELF_TEST */
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
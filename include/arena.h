@@ -0,0 +1,73 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2021 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        arena.h
+ * @brief       Arena (region) allocator user library header file
+ *
+ * @version     V1.2021.05
+ * @authors     Yiqing Huang
+ * @date        2021 MAY
+ *
+ * @details     An arena is one block from mem_alloc. Objects are carved out
+ *              of it by bumping a pointer, without trapping into the kernel,
+ *              and are all freed at once by mem_arena_reset or
+ *              mem_arena_destroy.
+ *
+ *****************************************************************************/
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include "rtx.h"
+
+/*
+ *===========================================================================
+ *                             MACROS
+ *===========================================================================
+ */
+
+#define ARENA_ALIGN         8       /* alignment of arena objects in bytes */
+
+/*
+ *===========================================================================
+ *                             STRUCTURES
+ *===========================================================================
+ */
+
+/**
+ * @brief arena header, sits at the start of the backing block
+ */
+typedef struct mem_arena
+{
+    U8          *cur;               /**< next free byte                     */
+    U8          *end;               /**< end of the backing block           */
+} MEM_ARENA;
+
+/*
+ *===========================================================================
+ *                            FUNCTION PROTOTYPES
+ *===========================================================================
+ */
+
+MEM_ARENA  *mem_arena_create    (size_t size);
+void       *mem_arena_alloc     (MEM_ARENA *arena, size_t n);
+void        mem_arena_reset     (MEM_ARENA *arena);
+int         mem_arena_destroy   (MEM_ARENA *arena);
+
+#endif // !ARENA_H_
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
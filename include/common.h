@@ -94,8 +94,11 @@
 #define EDF                 12      /* earliest-deadline-first scheduling */
 
 
-#define MAX_TASKS           0x10    /* maximum number of tasks in the system */
-#define KERN_STACK_SIZE     0x300   /* task kernel stack size in bytes */
+#ifndef MAX_TASKS
+#define MAX_TASKS           0x10    /* maximum number of tasks in the system, up to
+                                       TID_UART_IRQ, an unused task costs a TCB pointer */
+#endif
+#define KERN_STACK_SIZE     0x300   /* task kernel stack size in bytes, a multiple of 8 */
 #define PROC_STACK_SIZE     0x200   /* minimum task user stack size in bytes */
 #define TID_NULL            0x0     /* reserved Task ID for the null task */
 #define TID_KCD             (MAX_TASKS -1)     
@@ -164,6 +167,7 @@ typedef short               S16;
 typedef unsigned short      U16;
 typedef int                 S32;
 typedef unsigned int        U32;
+typedef unsigned long long  U64;
 typedef unsigned char       BOOL;
 typedef unsigned int        size_t;
 typedef signed int          ssize_t;
@@ -195,6 +199,16 @@ typedef struct task_init
     U8          priv;               /**< = 0 unprivileged, =1 privileged    */    
 } TASK_INIT;
 
+/**
+ * @brief tsk_create_ext task attributes, a TASK_INIT followed by the extensions
+ * @note  TASK_INIT keeps its lab layout, the prebuilt AE library fills arrays of it
+ */
+typedef struct task_init_ext
+{
+    TASK_INIT   init;               /**< as for tsk_create and rtx_init     */
+    U32         u_heap_size;        /**< private heap size in bytes, 0 = none */
+} TASK_INIT_EXT;
+
 /**
  * @brief Task information structure
  * @note  The highest location used by the stack is the first word below the stack base
@@ -215,6 +229,23 @@ typedef struct rtx_task_info
     U8          state;              /**< task state                         */
 } RTX_TASK_INFO;
 
+/**
+ * @brief tsk_get_ext and tsk_get_all task information, an RTX_TASK_INFO
+ *        followed by the extensions
+ * @note  RTX_TASK_INFO keeps its lab layout, the prebuilt AE library passes
+ *        buffers of that size to tsk_get
+ */
+typedef struct rtx_task_info_ext
+{
+    RTX_TASK_INFO info;             /**< as filled by tsk_get               */
+    U32         mem_quota;          /**< user heap quota in bytes, 0 = none */
+    U32         mem_used;           /**< user heap bytes held by the task   */
+    U64         cpu_user;           /**< CPU cycles run in thread mode      */
+    U64         cpu_kernel;         /**< CPU cycles spent in its SVCs       */
+    U32         u_stack_hwm;        /**< peak user stack usage in bytes     */
+    U32         k_stack_hwm;        /**< peak kernel stack usage in bytes   */
+} RTX_TASK_INFO_EXT;
+
 #endif // ! COMMON_H_
 /*
  *===========================================================================
@@ -52,11 +52,60 @@
  *===========================================================================
  */
 
+/* Extended TRAP NUMBERS, start from 0x20 to leave room for the lab ones */
+#define SVC_RTX_IDLE        0x20
+#define SVC_TSK_CREATE_EXT  0x21
+#define SVC_MEM_SET_QUOTA   0x22
+#define SVC_MEM_HALLOC      0x23
+#define SVC_MEM_HFREE       0x24
+#define SVC_MEM_LOCK        0x25
+#define SVC_MEM_UNLOCK      0x26
+#define SVC_MEM_CALLOC      0x27
+#define SVC_MEM_PROF_DUMP   0x28
+#define SVC_MEM_SNAPSHOT    0x29
+#define SVC_MEM_SNAPSHOT_DIFF 0x2A
+#define SVC_MEM_DUMP_BIN    0x2B
+#define SVC_MEM_PRESSURE    0x2C
+#define SVC_MEM_PRESSURE_WAIT 0x2D
+#define SVC_MEM_ALLOC_FLAGS 0x2E
+#define SVC_TSK_LS          0x2F
+#define SVC_TSK_GET_ALL     0x30
+#define SVC_TSK_TOP         0x31
+#define SVC_SCHED_HIST      0x32
+#define SVC_TSK_SWITCH_PROF 0x33
+#define SVC_TSK_SWITCH_STAT 0x34
+#define SVC_TSK_GET_EXT     0x35
+
+#define MHANDLE_NULL        0       /* invalid movable memory handle */
+
+#define MEM_SNAP_GRANULES   0x200   /* 8B granules of the user heap (RAM1_SIZE >> 3) */
+
+/* user heap pressure levels, see mem_pressure and mem_pressure_wait */
+#define MEM_PRESSURE_NONE   0       /* plenty of free memory, caches may grow */
+#define MEM_PRESSURE_LOW    1       /* free memory below the low watermark */
+#define MEM_PRESSURE_HIGH   2       /* free memory below the high watermark */
+#define MEM_PRESSURE_CRITICAL 3     /* an allocation just ran out of memory */
+
+/* mem_alloc_flags placement hints */
+#define MEM_FAST            0x1     /* CPU local SRAM (IRAM1), the default */
+#define MEM_DMA             0x2     /* AHB SRAM (IRAM2), reachable by the GPDMA */
+#define MEM_ANY             0x4     /* fall back to the other SRAM when full */
+
+/* scheduler histograms, see sched_hist */
+#define SCHED_HIST_LEVELS   5       /* HIGH..LOWEST, then the null task level */
+#define SCHED_WAIT_BUCKETS  32      /* bucket i: READY for [2^i, 2^(i+1)) cycles */
+#define SCHED_QLEN_BUCKETS  6       /* bucket i: [2^i, 2^(i+1)) tasks queued, the last
+                                       bucket also counts longer queues */
+
+/* context switch timings of SWITCH_PROFILE builds, see tsk_switch_stat */
+#define SWITCH_KINDS        4       /* index (old priv << 1) | new priv */
+
 /*
  *===========================================================================
  *                             TYPEDEFS
  *===========================================================================
  */
+typedef unsigned int    mhandle_t;  /* handle of a movable memory block */
 
 
 /*
@@ -64,7 +113,29 @@
  *                             STRUCTURES
  *===========================================================================
  */
- 
+
+/* user heap snapshot, filled by mem_snapshot and compared by mem_snapshot_diff */
+typedef struct mem_snapshot
+{
+    unsigned char live[MEM_SNAP_GRANULES >> 3];     /* bit set at the start of each live block */
+    unsigned char owner[MEM_SNAP_GRANULES];         /* owner of each live block, kernel internal */
+} MEM_SNAPSHOT;
+
+/* per priority level scheduler histograms, filled by sched_hist */
+typedef struct sched_hist
+{
+    unsigned int wait[SCHED_HIST_LEVELS][SCHED_WAIT_BUCKETS];  /* enqueue to dispatch, DWT cycles */
+    unsigned int qlen[SCHED_HIST_LEVELS][SCHED_QLEN_BUCKETS];  /* queue length after each enqueue */
+} SCHED_HIST;
+
+/* k_tsk_switch timing of one privilege pair, filled by tsk_switch_stat */
+typedef struct switch_stat
+{
+    unsigned int count;             /* switches timed */
+    unsigned int min;               /* fastest switch in cycles */
+    unsigned int max;               /* slowest switch in cycles */
+    unsigned long long total;       /* sum of all timed switches in cycles */
+} SWITCH_STAT;
 
 
  /*
@@ -0,0 +1,87 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2021 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        fbpool.h
+ * @brief       Interrupt safe fixed-block pool library header file
+ *
+ * @version     V1.2021.05
+ * @authors     Yiqing Huang
+ * @date        2021 MAY
+ *
+ * @details     A fixed-block pool hands out blocks of one size from a LIFO
+ *              free list updated with LDREX/STREX. mem_fbpool_alloc and
+ *              mem_fbpool_free neither trap into the kernel nor disable
+ *              interrupts, so ISRs and tasks may share a pool, e.g. a UART
+ *              ISR fills a block and passes it to a task which frees it.
+ *              Pools are set up in thread mode by mem_fbpool_init over
+ *              static storage or by mem_fbpool_create from the user heap.
+ *
+ *****************************************************************************/
+
+#ifndef FBPOOL_H_
+#define FBPOOL_H_
+
+#include "rtx.h"
+
+/*
+ *===========================================================================
+ *                             MACROS
+ *===========================================================================
+ */
+
+#define FBPOOL_ALIGN        8       /* alignment and size granule of blocks */
+
+/*
+ *===========================================================================
+ *                             STRUCTURES
+ *===========================================================================
+ */
+
+/**
+ * @brief free block, the link lives in the block itself
+ */
+typedef struct fb_node
+{
+    struct fb_node *next;           /**< next free block                    */
+} FB_NODE;
+
+/**
+ * @brief fixed-block pool header
+ */
+typedef struct mem_fbpool
+{
+    FB_NODE * volatile head;        /**< free list, only changed by STREX   */
+    U8          *start;             /**< first block                        */
+    U8          *end;               /**< end of the last block              */
+    U32          blk_size;          /**< block size in bytes                */
+} MEM_FBPOOL;
+
+/*
+ *===========================================================================
+ *                            FUNCTION PROTOTYPES
+ *===========================================================================
+ */
+
+int         mem_fbpool_init     (MEM_FBPOOL *pool, void *buf, size_t blk_size, size_t num);
+MEM_FBPOOL *mem_fbpool_create   (size_t blk_size, size_t num);
+void       *mem_fbpool_alloc    (MEM_FBPOOL *pool);
+int         mem_fbpool_free     (MEM_FBPOOL *pool, void *blk);
+int         mem_fbpool_destroy  (MEM_FBPOOL *pool);
+
+#endif // !FBPOOL_H_
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
@@ -38,13 +38,43 @@
  * @see         rtx_ext.h
  * @see         common.h
  *****************************************************************************/
- 
+
+#ifndef _RTX_EXT_H_
+#define _RTX_EXT_H_
+
+#include "common.h"
+
  /*
  *===========================================================================
  *                            FUNCTION PROTOTYPES
  *===========================================================================
  */
- 
+
+__svc(SVC_RTX_IDLE)     int     rtx_idle(void);     /* null task housekeeping */
+__svc(SVC_TSK_CREATE_EXT) int   tsk_create_ext(task_t *task, TASK_INIT_EXT *info);
+__svc(SVC_MEM_SET_QUOTA) int    mem_set_quota(task_t task_id, U32 quota);
+__svc(SVC_MEM_HALLOC)   mhandle_t mem_halloc(size_t size);  /* movable block */
+__svc(SVC_MEM_HFREE)    int     mem_hfree(mhandle_t handle);
+__svc(SVC_MEM_LOCK)     void   *mem_lock(mhandle_t handle);  /* pin and map */
+__svc(SVC_MEM_UNLOCK)   int     mem_unlock(mhandle_t handle);
+__svc(SVC_MEM_CALLOC)   void   *mem_calloc(size_t num, size_t size);
+__svc(SVC_MEM_PROF_DUMP) int    mem_prof_dump(void);    /* MEM_PROFILE builds */
+__svc(SVC_MEM_SNAPSHOT) int     mem_snapshot(MEM_SNAPSHOT *snap);
+__svc(SVC_MEM_SNAPSHOT_DIFF) int mem_snapshot_diff(MEM_SNAPSHOT *snap); /* new live blocks */
+__svc(SVC_MEM_DUMP_BIN) int     mem_dump_bin(void *buf, size_t size);   /* NULL buf: to UART */
+__svc(SVC_MEM_PRESSURE) int     mem_pressure(void);     /* current MEM_PRESSURE_ level */
+__svc(SVC_MEM_PRESSURE_WAIT) int mem_pressure_wait(U8 level); /* block until pressure >= level */
+__svc(SVC_MEM_ALLOC_FLAGS) void *mem_alloc_flags(size_t size, U32 flags); /* MEM_FAST, MEM_DMA, MEM_ANY */
+__svc(SVC_TSK_LS)       int     tsk_ls(task_t *buf, int count);    /* tids of the live tasks */
+__svc(SVC_TSK_GET_EXT)  int     tsk_get_ext(task_t task_id, RTX_TASK_INFO_EXT *buffer); /* tsk_get plus usage */
+__svc(SVC_TSK_GET_ALL)  int     tsk_get_all(RTX_TASK_INFO_EXT *buf, int count); /* tsk_get_ext of every live task */
+__svc(SVC_TSK_TOP)      int     tsk_top(void);      /* CPU time summary to UART */
+__svc(SVC_SCHED_HIST)   int     sched_hist(SCHED_HIST *buf, BOOL reset); /* copy, then clear if reset */
+__svc(SVC_TSK_SWITCH_PROF) int  tsk_switch_prof_dump(void); /* SWITCH_PROFILE builds */
+__svc(SVC_TSK_SWITCH_STAT) int  tsk_switch_stat(SWITCH_STAT *buf, BOOL reset); /* SWITCH_KINDS entries, then clear if reset */
+
+#endif // !_RTX_EXT_H_
+
  /*
  *===========================================================================
  *                             END OF FILE
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Render the binary heap dump produced by mem_dump_bin / k_mpool_dump_bin.
+
+usage: heap_view.py <dump> [columns]
+
+<dump> is either a raw dump saved from the buffer given to mem_dump_bin,
+or a UART log holding "heap dump: <hex>" lines, in which case every dump
+in the log is rendered. Each map character stands for one MIN_BLK_SIZE
+granule: '.' free, '#' used.
+"""
+
+import re
+import struct
+import sys
+
+MAGIC = 0x4448
+VERSION = 1
+FREE = 0x80
+MIN_BLK_SIZE_LOG2 = 5
+HDR = struct.Struct("<HBBBBI")
+LINE_RE = re.compile(r"heap dump: ([0-9a-fA-F]+)")
+
+
+def decode(data):
+    magic, version, mpid, size_log2, num_levels, start = HDR.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version %d heap dump" % VERSION)
+    blocks = []     # (offset, size, free)
+    offset = 0
+    for i in range(HDR.size, len(data) - 1, 2):
+        tag, count = data[i], data[i + 1] + 1
+        size = 1 << (size_log2 - (tag & ~FREE))
+        for _ in range(count):
+            blocks.append((offset, size, bool(tag & FREE)))
+            offset += size
+    if offset != 1 << size_log2:
+        raise ValueError("dump covers 0x%x of 0x%x bytes" % (offset, 1 << size_log2))
+    return mpid, start, size_log2, blocks
+
+
+def render(data, columns):
+    mpid, start, size_log2, blocks = decode(data)
+    granule = 1 << MIN_BLK_SIZE_LOG2
+
+    cells = []
+    for _, size, free in blocks:
+        cells.extend(("." if free else "#") * (size // granule))
+    print("mpid %d at 0x%08x, 0x%x bytes, one cell per 0x%x bytes"
+          % (mpid, start, 1 << size_log2, granule))
+    for row in range(0, len(cells), columns):
+        print("0x%08x  %s" % (start + row * granule, "".join(cells[row:row + columns])))
+
+    free_blocks = [size for _, size, free in blocks if free]
+    free_bytes = sum(free_blocks)
+    largest = max(free_blocks, default=0)
+    used = (1 << size_log2) - free_bytes
+    print("used 0x%x, free 0x%x in %d block(s), largest free 0x%x"
+          % (used, free_bytes, len(free_blocks), largest))
+    if free_bytes:
+        print("fragmentation %.1f%%" % (100.0 * (1 - largest / free_bytes)))
+    orders = {}
+    for size in free_blocks:
+        orders[size] = orders.get(size, 0) + 1
+    for size in sorted(orders):
+        print("  free 0x%-5x x %d" % (size, orders[size]))
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write(__doc__)
+        return 1
+    columns = int(argv[2]) if len(argv) > 2 else 64
+
+    with open(argv[1], "rb") as f:
+        raw = f.read()
+    if raw[:2] == struct.pack("<H", MAGIC):
+        render(raw, columns)
+        return 0
+
+    dumps = LINE_RE.findall(raw.decode("ascii", errors="replace"))
+    if not dumps:
+        sys.stderr.write("no heap dump found in %s\n" % argv[1])
+        return 1
+    for text in dumps:
+        render(bytes.fromhex(text), columns)
+        print()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
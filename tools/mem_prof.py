@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""
+Symbolize the mem_prof_dump output of a MEM_PROFILE build.
+
+usage: mem_prof.py <uart log> [map file]
+
+The map file defaults to RTX-App/Listings/rtx-app.map. Sites are printed
+by peak bytes, the function holding each call site is taken from the
+Image Symbol Table of the armlink map.
+"""
+
+import re
+import sys
+
+SITE_RE = re.compile(r"mem prof: 0x([0-9a-fA-F]+): allocs (\d+), live (\d+), peak (\d+)")
+SYM_RE = re.compile(r"^\s+(\S+)\s+0x([0-9a-fA-F]+)\s+(?:Thumb|ARM) Code\s+(\d+)\s+(\S+)")
+
+
+def load_symbols(path):
+    syms = []
+    with open(path, errors="replace") as f:
+        for line in f:
+            m = SYM_RE.match(line)
+            if m:
+                name, addr, size, obj = m.groups()
+                syms.append((int(addr, 16) & ~1, int(size), name, obj))
+    syms.sort()
+    return syms
+
+
+def symbolize(syms, pc):
+    # the stacked PC follows the SVC instruction, look up the SVC itself
+    addr = (pc & ~1) - 2
+    for start, size, name, obj in syms:
+        if start <= addr < start + size:
+            return "%s+0x%x (%s)" % (name, addr - start, obj)
+    return "?"
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write(__doc__)
+        return 1
+    map_path = argv[2] if len(argv) > 2 else "RTX-App/Listings/rtx-app.map"
+    syms = load_symbols(map_path)
+
+    # a log may hold several dumps, keep the last line seen for each site
+    sites = {}
+    with open(argv[1], errors="replace") as f:
+        for line in f:
+            m = SITE_RE.search(line)
+            if m:
+                pc, count, live, peak = (int(m.group(1), 16), int(m.group(2)),
+                                         int(m.group(3)), int(m.group(4)))
+                sites[pc] = (count, live, peak)
+
+    print("%-10s %8s %8s %8s  %s" % ("pc", "allocs", "live", "peak", "site"))
+    for pc, (count, live, peak) in sorted(sites.items(), key=lambda s: -s[1][2]):
+        print("0x%08x %8d %8d %8d  %s" % (pc, count, live, peak, symbolize(syms, pc)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))